@@ -141,17 +141,14 @@ void integrateGyro()
 
 void integrateEncoders()
 {
-  static int16_t lastCountsLeft;
-  int16_t countsLeft = encoders.getCountsLeft();
-  speedLeft = (countsLeft - lastCountsLeft);
-  distanceLeft += countsLeft - lastCountsLeft;
-  lastCountsLeft = countsLeft;
-
-  static int16_t lastCountsRight;
-  int16_t countsRight = encoders.getCountsRight();
-  speedRight = (countsRight - lastCountsRight);
-  distanceRight += countsRight - lastCountsRight;
-  lastCountsRight = countsRight;
+  // Read both encoders at the same instant.
+  Balboa32U4Encoders::Snapshot snapshot = encoders.getSnapshot();
+
+  speedLeft = snapshot.deltaLeft;
+  distanceLeft += snapshot.deltaLeft;
+
+  speedRight = snapshot.deltaRight;
+  distanceRight += snapshot.deltaRight;
 }
 
 void balanceDrive(int16_t leftSpeed, int16_t rightSpeed)
@@ -2,10 +2,10 @@
 // Balboa 32U4.
 //
 // This example demonstrates the use of the playFrequency(),
-// playNote(), and playFromProgramSpace() functions, which play
-// entirely in the background, requiring no further action from
-// the user once the function is called.  The CPU is then free to
-// execute other code while the buzzer plays.
+// playNote(), playFromProgramSpace(), and playCompiled()
+// functions, which play entirely in the background, requiring no
+// further action from the user once the function is called.  The
+// CPU is then free to execute other code while the buzzer plays.
 //
 // This example also shows how to use the stopPlaying() function
 // to stop the buzzer, and it shows how to use the isPlaying()
@@ -29,6 +29,19 @@ const char fugue[] PROGMEM =
   "O5 e>ee>ef>df>d b->c#b->c#a>df>d e>ee>ef>df>d"
   "e>d>c#>db>d>c#b >c#agaegfe f O6 dc#dfdc#<b c#4";
 
+// Store a short arpeggio as compiled notes.  The compiler works
+// out the timer settings for each note, so starting each note
+// takes only a few microseconds instead of the time it takes to
+// parse a note from a string.
+const Balboa32U4BuzzerNote arpeggio[] PROGMEM = {
+  BUZZER_NOTE(NOTE_C(5), 125, 12),
+  BUZZER_NOTE(NOTE_E(5), 125, 12),
+  BUZZER_NOTE(NOTE_G(5), 125, 12),
+  BUZZER_REST(125),
+  BUZZER_NOTE(NOTE_C(6), 375, 12),
+  BUZZER_END
+};
+
 void setup()       // run once, when the sketch starts
 {
 }
@@ -59,4 +72,10 @@ void loop()        // run over and over again
   while(buzzer.isPlaying()){ }
 
   delay(1000);
+
+  // Play the compiled arpeggio.
+  buzzer.playCompiled(arpeggio);
+  while(buzzer.isPlaying()){ }
+
+  delay(1000);
 }
@@ -14,12 +14,15 @@
 #endif
 
 #include <FastGPIO.h>
+#include <Balboa32U4ADC.h>
 #include <Balboa32U4Buttons.h>
 #include <Balboa32U4Buzzer.h>
 #include <Balboa32U4Encoders.h>
 #include <Balboa32U4LCD.h>
 #include <Balboa32U4LineSensors.h>
 #include <Balboa32U4Motors.h>
+#include <Balboa32U4Odometry.h>
+#include <Balboa32U4SpeedControl.h>
 
 // TODO: servo support
 
@@ -71,9 +74,16 @@ inline bool usbPowerPresent()
 /*! \brief Reads the battery voltage and returns it in millivolts.
 
 If this function returns a number below 5500, the actual battery voltage might
-be significantly lower than the value returned. */
+be significantly lower than the value returned.
+
+If Balboa32U4ADC is sampling in the background, this returns its filtered
+battery reading (see Balboa32U4ADC::getBatteryMillivolts()) without waiting.
+Otherwise, it takes 8 readings with analogRead(), which takes about 1 ms. */
 inline uint16_t readBatteryMillivolts()
 {
+    uint16_t sampled = Balboa32U4ADC::getBatteryMillivoltsIfRunning();
+    if (sampled) { return sampled; }
+
     const uint8_t sampleCount = 8;
     uint16_t sum = 0;
     for (uint8_t i = 0; i < sampleCount; i++)
@@ -0,0 +1,175 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4ADC.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <Arduino.h>
+
+// Values are stored with this many fractional bits, so the filters do not
+// lose precision.  1023 << 5 still fits in an int16_t.
+#define VALUE_SHIFT 5
+
+#define MAX_FILTER_SHIFT 6
+
+struct Channel
+{
+    // The ADC channel number (0 to 13).  Bit 3 goes in MUX5.
+    uint8_t mux;
+    uint8_t filterShift;
+
+    // The filtered value times 2^VALUE_SHIFT.
+    volatile int16_t value;
+    volatile uint8_t sampleCount;
+};
+
+// The battery is on A1, which is ADC channel 6 (PF6).  It is filtered with a
+// time constant of about 8 samples, like the 8-sample average taken by
+// readBatteryMillivolts().
+static Channel channels[Balboa32U4ADC::maxChannels] = { { 6, 3, 0, 0 } };
+static volatile uint8_t channelCount = 1;
+
+// The channel whose conversion is in progress or will be started by the next
+// trigger.
+static uint8_t currentChannel;
+
+// Incremented by the ISR every time it runs.  Code that reads a multi-byte
+// value written by the ISR reads this before and after, and tries again if it
+// changed.  This works because the ISR is the only writer and cannot be
+// interrupted by the reader.
+static volatile uint8_t generation;
+
+static inline void selectChannel(uint8_t mux) __attribute__((always_inline));
+static inline void selectChannel(uint8_t mux)
+{
+    ADMUX = (1 << REFS0) | (mux & 7);
+    ADCSRB = (ADCSRB & ~(1 << MUX5)) | ((mux >> 3 & 1) << MUX5);
+}
+
+ISR(ADC_vect)
+{
+    Channel & channel = channels[currentChannel];
+
+    int16_t sample = ADC << VALUE_SHIFT;
+    uint8_t count = channel.sampleCount;
+    if (count == 0)
+    {
+        // Start the filter at the first reading instead of ramping up from 0.
+        channel.value = sample;
+    }
+    else
+    {
+        channel.value += (sample - channel.value) >> channel.filterShift;
+    }
+    count++;
+    if (count == 0) { count = 1; }
+    channel.sampleCount = count;
+    generation++;
+
+    // The next conversion starts at the next Timer 0 overflow, so there is
+    // plenty of time to change the multiplexer.
+    uint8_t next = currentChannel + 1;
+    if (next >= channelCount) { next = 0; }
+    currentChannel = next;
+    selectChannel(channels[next].mux);
+}
+
+// Returns the battery voltage, or 0 if the battery has not been sampled yet.
+static uint16_t readBatteryIfSampled()
+{
+    if (channels[Balboa32U4ADC::batteryChannel].sampleCount == 0) { return 0; }
+    return Balboa32U4ADC::getBatteryMillivolts();
+}
+
+void Balboa32U4ADC::start()
+{
+    if (isRunning()) { return; }
+
+    batteryReader = readBatteryIfSampled;
+
+    currentChannel = 0;
+    selectChannel(channels[0].mux);
+
+    // Trigger conversions on the Timer 0 overflow flag.  The Arduino core's
+    // Timer 0 overflow ISR clears the flag, so there is a rising edge on it
+    // every 1.024 ms.
+    ADCSRB = (ADCSRB & ~((1 << ADTS3) | (1 << ADTS2) | (1 << ADTS1) | (1 << ADTS0)))
+        | (1 << ADTS2);
+
+    // Enable the ADC with a 125 kHz clock (the same as analogRead()), enable
+    // auto triggering and the conversion complete interrupt, and clear any
+    // stale interrupt flag.
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIF) | (1 << ADIE)
+        | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+}
+
+void Balboa32U4ADC::stop()
+{
+    batteryReader = 0;
+    ADCSRA &= ~((1 << ADATE) | (1 << ADIE));
+    while (ADCSRA & (1 << ADSC)) { }
+    ADCSRA |= (1 << ADIF);
+}
+
+bool Balboa32U4ADC::isRunning()
+{
+    return ADCSRA & (1 << ADIE);
+}
+
+int8_t Balboa32U4ADC::addChannel(uint8_t pin, uint8_t filterShift)
+{
+    uint8_t index = channelCount;
+    if (index >= maxChannels) { return -1; }
+
+    // Convert the pin number the same way analogRead() does.
+    if (pin >= 18) { pin -= 18; }
+
+    Channel & channel = channels[index];
+    channel.mux = analogPinToChannel(pin);
+    channel.filterShift = filterShift > MAX_FILTER_SHIFT ? MAX_FILTER_SHIFT : filterShift;
+    channel.value = 0;
+    channel.sampleCount = 0;
+
+    // The ISR only looks at the new entry after this, so it is safe to add a
+    // channel while sampling is running.
+    channelCount = index + 1;
+    return index;
+}
+
+uint16_t Balboa32U4ADC::getValue(uint8_t channel)
+{
+    if (channel >= channelCount) { return 0; }
+
+    uint8_t g;
+    int16_t value;
+    do
+    {
+        g = generation;
+        value = channels[channel].value;
+    } while (g != generation);
+
+    // Round to the nearest whole number.
+    return (value + (1 << (VALUE_SHIFT - 1))) >> VALUE_SHIFT;
+}
+
+uint8_t Balboa32U4ADC::getSampleCount(uint8_t channel)
+{
+    if (channel >= channelCount) { return 0; }
+    return channels[channel].sampleCount;
+}
+
+uint16_t Balboa32U4ADC::getBatteryMillivolts()
+{
+    uint8_t g;
+    uint16_t value;
+    do
+    {
+        g = generation;
+        value = channels[batteryChannel].value;
+    } while (g != generation);
+
+    // VBAT = raw * 1875 / 128 (see readBatteryMillivolts()), and value is
+    // raw * 2^VALUE_SHIFT.  Add half of the divisor to round to the nearest
+    // millivolt.
+    const uint16_t divisor = 128 << VALUE_SHIFT;
+    return ((uint32_t)value * 1875 + divisor / 2) / divisor;
+}
@@ -0,0 +1,134 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4ADC.h */
+
+#pragma once
+
+#include <stdint.h>
+
+/*! \brief Samples analog inputs in the background using interrupts.
+ *
+ * The Arduino analogRead() function starts a conversion and then waits about
+ * 110 microseconds for it to finish.  This class instead keeps the
+ * ATmega32U4's analog-to-digital converter (ADC) running in the background on
+ * a list of channels, so reading the latest value of a channel takes only a
+ * few instructions.
+ *
+ * Conversions are triggered by the Timer 0 overflow that the Arduino core
+ * already uses for millis(), so one conversion happens every 1.024 ms and the
+ * channels take turns.  For example, with three channels, each channel is
+ * sampled every 3.072 ms.  The ISR for ADC_vect that stores each result takes
+ * only a few microseconds, so the background sampling uses less than 1% of
+ * the CPU time.
+ *
+ * Each channel can optionally be smoothed with a first-order low-pass filter
+ * (an exponential moving average).  The battery voltage input (A1) is always
+ * channel 0 and is filtered, so getBatteryMillivolts() returns a stable value
+ * immediately.
+ *
+ * While sampling is running, the ADC belongs to this class: you should not
+ * call analogRead() or use the analog comparator multiplexer, and the
+ * ADC_vect ISR is defined by this class.  Call stop() if you need to use
+ * analogRead() again.  readBatteryMillivolts() automatically uses this class
+ * while sampling is running.
+ *
+ * The ISR is only linked into sketches that call one of the functions below
+ * other than getBatteryMillivoltsIfRunning(), so readBatteryMillivolts() and
+ * Balboa32U4Motors::setBatteryCompensation() do not take the ADC_vect
+ * interrupt away from sketches that do not use this class.
+ *
+ * None of the functions in this class disable interrupts.
+ *
+ * Example:
+ *
+ * ~~~{.cpp}
+ * int8_t potentiometer;
+ *
+ * void setup()
+ * {
+ *   potentiometer = Balboa32U4ADC::addChannel(A0);
+ *   Balboa32U4ADC::start();
+ * }
+ *
+ * void loop()
+ * {
+ *   uint16_t position = Balboa32U4ADC::getValue(potentiometer);
+ *   uint16_t battery = Balboa32U4ADC::getBatteryMillivolts();
+ *   // ...
+ * }
+ * ~~~
+ */
+class Balboa32U4ADC
+{
+public:
+
+    /*! The maximum number of channels, including the battery channel. */
+    static const uint8_t maxChannels = 8;
+
+    /*! The channel number of the battery voltage input. */
+    static const uint8_t batteryChannel = 0;
+
+    /*! Starts sampling the channels in the background.  The ADC is set up to
+     *  use AVCC (5 V) as its reference, like analogRead() with the default
+     *  reference. */
+    static void start();
+
+    /*! Stops sampling, waiting for any conversion in progress to finish.
+     *  After this, analogRead() can be used again.  The latest values of the
+     *  channels are kept. */
+    static void stop();
+
+    /*! Returns true if the ADC is sampling in the background. */
+    static bool isRunning();
+
+    /*! Adds an analog input to the list of channels to sample.
+     *
+     * \param pin The Arduino pin number of the input, such as A0 or 0, as you
+     *   would pass it to analogRead().
+     * \param filterShift How much to smooth the readings.  0 disables the
+     *   filter, so getValue() returns the latest reading.  Otherwise, each new
+     *   reading moves the filtered value 1/2^filterShift of the way toward it,
+     *   so higher numbers give smoother but slower values.  The maximum is 6.
+     *
+     * \return The channel number to pass to getValue(), or -1 if there are
+     *   already #maxChannels channels.
+     *
+     * Channels can be added while sampling is running. */
+    static int8_t addChannel(uint8_t pin, uint8_t filterShift = 0);
+
+    /*! Returns the latest (optionally filtered) value of a channel, from 0 to
+     *  1023, or 0 if the channel has not been sampled yet. */
+    static uint16_t getValue(uint8_t channel);
+
+    /*! Returns the number of times the channel has been sampled.  This wraps
+     *  around from 255 to 1, and is only 0 before the first sample, so you can
+     *  compare it to an earlier return value to tell if there is a new
+     *  sample. */
+    static uint8_t getSampleCount(uint8_t channel);
+
+    /*! Returns the battery voltage in millivolts, computed from the filtered
+     * value of channel 0.
+     *
+     * This returns 0 until the first sample has been taken.  As with
+     * readBatteryMillivolts(), if this returns a number below 5500, the
+     * actual battery voltage might be significantly lower.
+     *
+     * While sampling is running, Balboa32U4Motors uses this value (through
+     * getBatteryMillivoltsIfRunning()) to keep its battery compensation up to
+     * date (see Balboa32U4Motors::setBatteryCompensation()). */
+    static uint16_t getBatteryMillivolts();
+
+    /*! Returns the same value as getBatteryMillivolts() if sampling is
+     *  running, or 0 otherwise (including before the first sample).
+     *
+     * This function is in a separate file from the rest of this class, so
+     * calling it does not link the ADC_vect ISR into your sketch. */
+    static uint16_t getBatteryMillivoltsIfRunning();
+
+private:
+
+    // Set by start() and cleared by stop(), so that
+    // getBatteryMillivoltsIfRunning() does not refer to the rest of this
+    // class.
+    static uint16_t (*batteryReader)();
+};
@@ -0,0 +1,16 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+// This is in its own file so that readBatteryMillivolts() and battery
+// compensation in Balboa32U4Motors can use the background readings without
+// linking Balboa32U4ADC.cpp, and its ADC_vect ISR, into every sketch.  This
+// relies on dot_a_linkage, which only applies to the src directory.
+
+#include <Balboa32U4ADC.h>
+
+uint16_t (*Balboa32U4ADC::batteryReader)() = 0;
+
+uint16_t Balboa32U4ADC::getBatteryMillivoltsIfRunning()
+{
+    uint16_t (*reader)() = batteryReader;
+    return reader ? reader() : 0;
+}
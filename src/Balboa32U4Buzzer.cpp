@@ -0,0 +1,79 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4Buzzer.h>
+
+const Balboa32U4Buzzer::Timer3Functions * Balboa32U4Buzzer::timer3 = 0;
+bool Balboa32U4Buzzer::timer3Enabled = false;
+uint8_t Balboa32U4Buzzer::mode = PLAY_AUTOMATIC;
+
+void Balboa32U4Buzzer::playFrequency(unsigned int freq, unsigned int duration,
+    unsigned char volume)
+{
+    if (timer3) { timer3->stop(); }
+    if (!timer3Enabled)
+    {
+        PololuBuzzer::playFrequency(freq, duration, volume);
+        return;
+    }
+
+    // Stop any sequence, which would otherwise wait forever for the overflow
+    // interrupt.
+    PololuBuzzer::stopPlaying();
+    timer3->play(Balboa32U4BuzzerCompiler::frequency(freq, duration, volume));
+}
+
+void Balboa32U4Buzzer::playNote(unsigned char note, unsigned int duration,
+    unsigned char volume)
+{
+    if (timer3) { timer3->stop(); }
+    if (!timer3Enabled)
+    {
+        PololuBuzzer::playNote(note, duration, volume);
+        return;
+    }
+
+    PololuBuzzer::stopPlaying();
+    timer3->play(Balboa32U4BuzzerCompiler::note(note, duration, volume));
+}
+
+void Balboa32U4Buzzer::play(const char * sequence)
+{
+    if (timer3) { timer3->stop(); }
+    PololuBuzzer::play(sequence);
+}
+
+void Balboa32U4Buzzer::playFromProgramSpace(const char * sequence)
+{
+    if (timer3) { timer3->stop(); }
+    PololuBuzzer::playFromProgramSpace(sequence);
+}
+
+void Balboa32U4Buzzer::playMode(unsigned char newMode)
+{
+    mode = newMode;
+    if (timer3) { timer3->setMode(newMode); }
+    PololuBuzzer::playMode(newMode);
+
+    // PololuBuzzer::playMode() calls PololuBuzzer::playCheck() when switching
+    // to automatic mode, but that does not know about compiled melodies.  A
+    // compiled note that ended in PLAY_CHECK mode would otherwise leave the
+    // melody stuck.
+    if (newMode == PLAY_AUTOMATIC) { playCheck(); }
+}
+
+unsigned char Balboa32U4Buzzer::playCheck()
+{
+    bool compiled = timer3 && timer3->check();
+    return PololuBuzzer::playCheck() || compiled;
+}
+
+unsigned char Balboa32U4Buzzer::isPlaying()
+{
+    return (timer3 && timer3->isPlaying()) || PololuBuzzer::isPlaying();
+}
+
+void Balboa32U4Buzzer::stopPlaying()
+{
+    if (timer3) { timer3->stop(); }
+    PololuBuzzer::stopPlaying();
+}
@@ -0,0 +1,289 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4Buzzer.h */
+
+#pragma once
+
+#include <PololuBuzzer.h>
+#include <stdint.h>
+
+/*! \brief One note of a melody for Balboa32U4Buzzer::playCompiled().
+ *
+ * A compiled note holds the Timer 4 settings that `playFrequency()` would
+ * compute for the note, so starting it only takes a few register writes. You
+ * should not normally fill in these fields yourself; use the
+ * \ref compiled_note_macros "compiled note macros" instead.
+ *
+ * Each note takes 7 bytes of program space, which is more than the 2 or 3
+ * characters that a typical note takes in a `play()` sequence. */
+struct Balboa32U4BuzzerNote
+{
+    uint8_t clock;     // Timer 4 clock select bits, or 0 at the end of a melody
+    uint16_t top;      // Timer 4 TOP (sets the frequency)
+    uint16_t width;    // compare value (sets the duty cycle, i.e. the volume)
+    uint16_t timeout;  // duration in Timer 4 overflows
+};
+
+// Computes Balboa32U4BuzzerNote records with the same integer math as
+// PololuBuzzer::playNote() and PololuBuzzer::playFrequency(), so a compiled
+// note sounds exactly like the same note played by those functions.  Each
+// function is a single expression so that this works with C++11 constexpr.
+namespace Balboa32U4BuzzerCompiler
+{
+    // frequencies of the 12 lowest notes allowed, in tenths of a Hertz
+    constexpr uint16_t baseFrequency(uint8_t key)
+    {
+        return key == 0 ? 412 : key == 1 ? 437 : key == 2 ? 463 : key == 3 ? 490 :
+            key == 4 ? 519 : key == 5 ? 550 : key == 6 ? 583 : key == 7 ? 617 :
+            key == 8 ? 654 : key == 9 ? 693 : key == 10 ? 734 : 778;
+    }
+
+    constexpr uint8_t offsetNote(uint8_t note)
+    {
+        return note <= 16 ? 0 : (note - 16 > 95 ? 95 : note - 16);
+    }
+
+    constexpr uint16_t scaleFrequency(uint16_t freq, uint8_t exponent)
+    {
+        return exponent < 7 ?
+            (exponent > 1 ? (uint16_t)((((uint32_t)freq << exponent) + 5) / 10)
+                          : (uint16_t)(((uint32_t)freq << exponent) + DIV_BY_10)) :
+            (uint16_t)(((uint32_t)freq * 64 + 2) / 5);
+    }
+
+    constexpr uint16_t noteFrequency(uint8_t note)
+    {
+        return scaleFrequency(baseFrequency(offsetNote(note) % 12), offsetNote(note) / 12);
+    }
+
+    constexpr uint8_t multiplier(uint16_t freq)
+    {
+        return (freq & DIV_BY_10) ? 10 : 1;
+    }
+
+    constexpr uint16_t limitFrequency(uint16_t freq, uint8_t multiplier)
+    {
+        return freq < (uint8_t)(40 * multiplier) ? (uint8_t)(40 * multiplier) :
+            (multiplier == 1 && freq > 10000) ? 10000 : freq;
+    }
+
+    // Timer 4 is 10-bit, and its clock is divided by 2^(clock - 1).
+    constexpr uint16_t timerTop(uint16_t freq, uint8_t multiplier, uint8_t clock)
+    {
+        return (uint16_t)((((uint32_t)(F_CPU/2) >> (clock - 1)) * multiplier + (freq >> 1)) / freq);
+    }
+
+    constexpr uint8_t timerClock(uint16_t freq, uint8_t multiplier, uint8_t clock = 1)
+    {
+        return timerTop(freq, multiplier, clock) > 1023 ?
+            timerClock(freq, multiplier, clock + 1) : clock;
+    }
+
+    constexpr uint16_t timeout(uint16_t freq, uint8_t multiplier, uint16_t duration)
+    {
+        return multiplier == 10 ? timeout((freq + 5) / 10, 1, duration) :
+            freq == 1000 ? duration : (uint16_t)((uint32_t)duration * freq / 1000);
+    }
+
+    constexpr Balboa32U4BuzzerNote compile(uint16_t freq, uint8_t multiplier,
+        uint8_t clock, uint16_t duration, uint8_t volume)
+    {
+        return Balboa32U4BuzzerNote{ clock, timerTop(freq, multiplier, clock),
+            (uint16_t)(volume == 0 ? 0 : timerTop(freq, multiplier, clock) >> (16 - volume)),
+            timeout(freq, multiplier, duration) };
+    }
+
+    constexpr Balboa32U4BuzzerNote frequency(uint16_t freq, uint16_t duration, uint8_t volume)
+    {
+        return compile(limitFrequency(freq & ~DIV_BY_10, multiplier(freq)), multiplier(freq),
+            timerClock(limitFrequency(freq & ~DIV_BY_10, multiplier(freq)), multiplier(freq)),
+            duration, volume > 15 ? 15 : volume);
+    }
+
+    constexpr Balboa32U4BuzzerNote note(uint8_t n, uint16_t duration, uint8_t volume)
+    {
+        return (n == SILENT_NOTE || volume == 0) ? frequency(1000, duration, 0) :
+            frequency(noteFrequency(n), duration, volume);
+    }
+}
+
+/*! \anchor compiled_note_macros
+ *
+ * \name Compiled Note Macros
+ *
+ * These macros compute the entries of a melody for
+ * Balboa32U4Buzzer::playCompiled() at compile time.
+ * @{
+ */
+
+/*! \brief A note, like `playNote()` (\a n is a note, \a dur is in ms, and
+ *  \a vol is 0--15). */
+#define BUZZER_NOTE(n, dur, vol) \
+    (Balboa32U4BuzzerCompiler::note((n), (dur), (vol)))
+
+/*! \brief A frequency, like `playFrequency()` (\a freq is in Hz, or 0.1 Hz
+ *  with `DIV_BY_10`). */
+#define BUZZER_FREQUENCY(freq, dur, vol) \
+    (Balboa32U4BuzzerCompiler::frequency((freq), (dur), (vol)))
+
+/*! \brief Silence for \a dur ms. */
+#define BUZZER_REST(dur) BUZZER_NOTE(SILENT_NOTE, (dur), 0)
+
+/*! \brief Marks the end of a compiled melody.  Every melody must end with
+ *  this. */
+#define BUZZER_END (Balboa32U4BuzzerNote{ 0, 0, 0, 0 })
+/*! @} */
+
+/*! \brief Plays beeps and music on the buzzer on the Balboa 32U4.
+ *
+ * This class uses Timer 4 and pin 6 (PD7/OC4D) to play beeps and melodies on
+ * the Balboa 32U4 buzzer.
+ *
+ * Note durations are timed using a timer overflow interrupt
+ * (`TIMER4_OVF`), which will briefly interrupt execution of your
+ * main program at the frequency of the sound being played. In most cases, the
+ * interrupt-handling routine is very short (several microseconds). However,
+ * when playing a sequence of notes in `PLAY_AUTOMATIC` mode (the default mode)
+ * with the `play()` command, this interrupt takes much longer than normal
+ * (perhaps several hundred microseconds) every time it starts a new note. It is
+ * important to take this into account when writing timing-critical code.
+ *
+ * Melodies played with playCompiled() do not have this problem because they
+ * are converted to timer settings at compile time. They are timed with the
+ * compare B channel of Timer 3 instead of the overflow interrupt, so they only
+ * interrupt your program once per note. Calling useTimer3() does the same for
+ * playFrequency() and playNote().
+ *
+ * Timer 3 is run in the same free-running configuration used by
+ * Balboa32U4Encoders and Balboa32U4LineSensors. This class defines an ISR for
+ * `TIMER3_COMPB_vect`, so there will be a link-time conflict with any other
+ * code that defines that ISR. The ISR is in its own object file, so it is
+ * only linked into sketches that call playCompiled() or useTimer3().
+ *
+ * The functions below hide the PololuBuzzer functions with the same names so
+ * that they can stop or check on notes timed with Timer 3. Calling the
+ * PololuBuzzer versions directly while a compiled melody is playing is not
+ * supported.
+ */
+class Balboa32U4Buzzer : public PololuBuzzer
+{
+public:
+
+    /*! \brief Plays the specified frequency for the specified duration.
+     *
+     * This works like PololuBuzzer::playFrequency(), except that the note is
+     * timed with Timer 3 if useTimer3() has been called. */
+    static void playFrequency(unsigned int freq, unsigned int duration,
+        unsigned char volume);
+
+    /*! \brief Plays the specified note for the specified duration.
+     *
+     * This works like PololuBuzzer::playNote(), except that the note is
+     * timed with Timer 3 if useTimer3() has been called. */
+    static void playNote(unsigned char note, unsigned int duration,
+        unsigned char volume);
+
+    /*! \brief Plays the specified sequence of notes.
+     *
+     * See PololuBuzzer::play().  Sequences are always timed with the
+     * `TIMER4_OVF` interrupt. */
+    static void play(const char * sequence);
+
+    /*! \brief Plays the specified sequence of notes from program space.
+     *
+     * See PololuBuzzer::playFromProgramSpace(). */
+    static void playFromProgramSpace(const char * sequence);
+
+    /*! \brief Plays a compiled melody from program space.
+     *
+     * \param notes Array in program space of notes made with the
+     *              \ref compiled_note_macros "compiled note macros" and ending
+     *              with `BUZZER_END`.
+     *
+     * The `play()` functions parse the sequence one note at a time, so starting
+     * each note takes a few hundred microseconds (inside the timer interrupt in
+     * `PLAY_AUTOMATIC` mode). A compiled melody is converted to timer settings
+     * by the compiler instead, so starting each note only takes a few
+     * microseconds and does not re-enable interrupts inside the timer
+     * interrupt. The play mode, playCheck(), isPlaying(), and stopPlaying()
+     * work the same way as with `play()`.
+     *
+     * ### Example ###
+     *
+     * ~~~{.cpp}
+     * Balboa32U4Buzzer buzzer;
+     * const Balboa32U4BuzzerNote melody[] PROGMEM = {
+     *   BUZZER_NOTE(NOTE_C(5), 125, 10),
+     *   BUZZER_NOTE(NOTE_E(5), 125, 10),
+     *   BUZZER_REST(125),
+     *   BUZZER_NOTE(NOTE_G(5), 250, 10),
+     *   BUZZER_END
+     * };
+     *
+     * ...
+     *
+     * buzzer.playCompiled(melody);
+     * ~~~
+     */
+    static void playCompiled(const Balboa32U4BuzzerNote * notes);
+
+    /*! \brief Controls whether sequences and compiled melodies are played
+     *  automatically or must be driven with playCheck().
+     *
+     * See PololuBuzzer::playMode(). */
+    static void playMode(unsigned char mode);
+
+    /*! \brief Starts the next note in a sequence or compiled melody, if
+     *  necessary, in `PLAY_CHECK` mode.
+     *
+     * See PololuBuzzer::playCheck(). */
+    static unsigned char playCheck();
+
+    /*! \brief Checks whether a note, sequence, or compiled melody is
+     *  currently being played. */
+    static unsigned char isPlaying();
+
+    /*! \brief Stops any note, sequence, or compiled melody that is currently
+     *  being played. */
+    static void stopPlaying();
+
+    /*! \brief Controls whether playFrequency() and playNote() time their notes
+     *  with Timer 3 instead of the `TIMER4_OVF` interrupt.
+     *
+     * \param enabled True to time notes with Timer 3, false to go back to the
+     *                default.
+     *
+     * By default, the `TIMER4_OVF` interrupt runs once per period of the sound
+     * and counts down the duration of the note, so a 4 kHz tone interrupts your
+     * program 4000 times per second. With Timer 3 timing, the overflow
+     * interrupt is turned off, and a `TIMER3_COMPB` interrupt runs once when
+     * the note is over (plus once every 65 ms for longer notes). The notes last
+     * exactly as long as they would otherwise.
+     *
+     * The setting takes effect with the next note. Sequences played with
+     * `play()` are always timed with the overflow interrupt. */
+    static void useTimer3(bool enabled);
+
+private:
+
+    // The functions that use Timer 3, which are in Balboa32U4BuzzerTimer3.cpp
+    // along with the TIMER3_COMPB_vect ISR.  The other functions of this
+    // class call them through the timer3 pointer, which stays 0 until
+    // playCompiled() or useTimer3() is called, so that sketches that do not
+    // use Timer 3 do not link that file.
+    struct Timer3Functions
+    {
+        void (*stop)();
+        bool (*isPlaying)();
+        bool (*check)();  // playCheck() for compiled melodies
+        void (*play)(const Balboa32U4BuzzerNote & note);
+        void (*setMode)(uint8_t mode);
+    };
+
+    static const Timer3Functions timer3Functions;
+    static const Timer3Functions * timer3;
+    static bool timer3Enabled;
+    static uint8_t mode;
+
+    static void attachTimer3();
+};
@@ -0,0 +1,222 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+// Compiled melodies and Timer 3 note timing for the Balboa 32U4 buzzer.  The
+// PololuBuzzer library times notes with its TIMER4_OVF ISR, which is turned
+// off while a note from this file is playing.
+//
+// This file is only linked into sketches that call playCompiled() or
+// useTimer3(), so the TIMER3_COMPB_vect ISR stays out of other sketches.
+// This relies on dot_a_linkage, which only applies to the src directory.
+
+#include <Balboa32U4Buzzer.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+// The longest wait for one Timer 3 compare (65 ms), which leaves plenty of
+// margin before the 16-bit counter catches up with the compare value.
+#define TIMER3_MAX_STEP 0x4000
+
+// The shortest wait for one Timer 3 compare, so that TCNT3 cannot pass OCR3B
+// before the compare is set up.
+#define TIMER3_MIN_STEP 2
+
+// A copy of the play mode for the ISR; see Balboa32U4Buzzer::playMode().
+static volatile uint8_t timer3Mode = PLAY_AUTOMATIC;
+
+// True while a note timed with Timer 3 is playing.
+static volatile bool timer3Playing;
+
+// The next note of a compiled melody, or 0 if none is playing.
+static const Balboa32U4BuzzerNote * volatile compiledNote;
+
+// Timer 3 ticks left in the current note after the next compare.
+static volatile uint32_t ticksLeft;
+
+static void initTimers()
+{
+    // Set up Timer 4 the same way as PololuBuzzer, since it might not have
+    // played anything yet: phase- and frequency-correct PWM with TOP = OCR4C,
+    // and OC4D cleared on compare match when upcounting.
+    TIMSK4 = 0;
+    TCCR4A = 0;
+    TCCR4C = 0x09;
+    TCCR4D = 0x01;
+    DDRD |= (1 << PORTD7);
+
+    TCCR3A = 0;
+    TCCR3B = (1 << CS31) | (1 << CS30);
+}
+
+// Plays 1 kHz at 0% duty cycle, like PololuBuzzer does between notes.
+static void silence()
+{
+    uint16_t top = (F_CPU/16) / 1000;
+    TCCR4B = (TCCR4B & 0xF0) | 0x04;
+    TC4H = top >> 8;
+    OCR4C = top;
+    TC4H = 0;
+    OCR4D = 0;
+}
+
+// Takes the next Timer 3 step off of ticksLeft, making sure that the last
+// step will not be shorter than TIMER3_MIN_STEP.
+static uint16_t nextStep()
+{
+    uint32_t ticks = ticksLeft;
+    uint16_t step = ticks > TIMER3_MAX_STEP ? TIMER3_MAX_STEP : ticks;
+    if (ticks > TIMER3_MAX_STEP && ticks - step < TIMER3_MIN_STEP)
+    {
+        step = TIMER3_MAX_STEP / 2;
+    }
+    ticksLeft = ticks - step;
+    return step;
+}
+
+// Starts playing a note and timing it with Timer 3.  Interrupts must be
+// disabled.
+static void startNote(const Balboa32U4BuzzerNote & note)
+{
+    TIMSK4 = 0;
+    TCCR4B = (TCCR4B & 0xF0) | note.clock;
+    TC4H = note.top >> 8;
+    OCR4C = note.top;
+    TC4H = note.width >> 8;
+    OCR4D = note.width;
+
+    // The note lasts for timeout + 1 overflows of Timer 4.  In phase- and
+    // frequency-correct mode, each overflow takes 2 * TOP Timer 4 clocks, or
+    // TOP << clock CPU cycles, and each Timer 3 tick is 64 CPU cycles.  The
+    // multiplication is done first when the product cannot overflow, and
+    // otherwise the cycles per overflow are a multiple of 64, so the result
+    // is exact either way.
+    uint32_t cycles = (uint32_t)note.top << note.clock;
+    uint32_t ticks;
+    if (note.clock >= 6)
+    {
+        ticks = (note.timeout + 1UL) * (cycles >> 6);
+    }
+    else
+    {
+        ticks = ((note.timeout + 1UL) * cycles) >> 6;
+    }
+    if (ticks < TIMER3_MIN_STEP) { ticks = TIMER3_MIN_STEP; }
+
+    ticksLeft = ticks;
+    OCR3B = TCNT3 + nextStep();
+    TIFR3 = (1 << OCF3B);
+    TIMSK3 |= (1 << OCIE3B);
+    timer3Playing = true;
+}
+
+// Starts the next note of the compiled melody, or returns false (and ends the
+// melody) if there are no more notes.  Interrupts must be disabled.
+static bool startCompiledNote()
+{
+    const Balboa32U4BuzzerNote * n = compiledNote;
+    Balboa32U4BuzzerNote note;
+    note.clock = pgm_read_byte(&n->clock);
+    if (note.clock == 0)
+    {
+        compiledNote = 0;
+        return false;
+    }
+    note.top = pgm_read_word(&n->top);
+    note.width = pgm_read_word(&n->width);
+    note.timeout = pgm_read_word(&n->timeout);
+    compiledNote = n + 1;
+    startNote(note);
+    return true;
+}
+
+// Stops any note timed with Timer 3 and forgets the compiled melody.  TIMSK3
+// is shared with other code, so it is changed with interrupts disabled.
+static void stopTimer3()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK3 &= ~(1 << OCIE3B);
+    timer3Playing = false;
+    compiledNote = 0;
+    SREG = oldSREG;
+}
+
+ISR(TIMER3_COMPB_vect)
+{
+    if (ticksLeft)
+    {
+        uint16_t next = OCR3B + nextStep();
+        uint16_t now = TCNT3;
+        if ((int16_t)(next - now) < TIMER3_MIN_STEP)
+        {
+            // This interrupt was delayed past the end of the step.
+            next = now + TIMER3_MIN_STEP;
+        }
+        OCR3B = next;
+        return;
+    }
+
+    TIMSK3 &= ~(1 << OCIE3B);
+    if (compiledNote && timer3Mode == PLAY_AUTOMATIC && startCompiledNote()) { return; }
+    silence();
+    timer3Playing = false;
+}
+
+// Plays a note from playFrequency() or playNote() with Timer 3 timing.
+static void timer3Play(const Balboa32U4BuzzerNote & note)
+{
+    initTimers();
+    uint8_t oldSREG = SREG;
+    cli();
+    startNote(note);
+    SREG = oldSREG;
+}
+
+static bool timer3IsPlaying()
+{
+    return timer3Playing || compiledNote != 0;
+}
+
+// Starts the next compiled note in PLAY_CHECK mode if the last one is over,
+// and returns true if the melody is not over.
+static bool timer3Check()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    if (!timer3Playing && compiledNote) { startCompiledNote(); }
+    bool compiled = compiledNote != 0;
+    SREG = oldSREG;
+    return compiled;
+}
+
+static void timer3SetMode(uint8_t newMode)
+{
+    timer3Mode = newMode;
+}
+
+const Balboa32U4Buzzer::Timer3Functions Balboa32U4Buzzer::timer3Functions =
+    { stopTimer3, timer3IsPlaying, timer3Check, timer3Play, timer3SetMode };
+
+void Balboa32U4Buzzer::attachTimer3()
+{
+    timer3Mode = mode;
+    timer3 = &timer3Functions;
+}
+
+void Balboa32U4Buzzer::playCompiled(const Balboa32U4BuzzerNote * notes)
+{
+    attachTimer3();
+    stopTimer3();
+    PololuBuzzer::stopPlaying();
+    initTimers();
+    uint8_t oldSREG = SREG;
+    cli();
+    compiledNote = notes;
+    if (!startCompiledNote()) { silence(); }  // empty melody
+    SREG = oldSREG;
+}
+
+void Balboa32U4Buzzer::useTimer3(bool enabled)
+{
+    if (enabled) { attachTimer3(); }
+    timer3Enabled = enabled;
+}
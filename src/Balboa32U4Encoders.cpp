@@ -0,0 +1,544 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4Encoders.h>
+#include <FastGPIO.h>
+#include <avr/interrupt.h>
+#include <Arduino.h>
+
+#define LEFT_XOR   8
+#define LEFT_B     IO_E2
+#define RIGHT_XOR  7
+#define RIGHT_B    23
+
+// Timer 3 ticks per second when edge timing is enabled (16 MHz / 64).
+#define EDGE_TICKS_PER_SECOND 250000
+
+// The number of edge timestamps stored for each wheel.  Must be a power of 2.
+#define EDGE_BUFFER_SIZE 8
+
+// Speeds are averaged over the edges seen in this many ticks (10 ms).
+#define EDGE_WINDOW 2500
+
+// After this many ticks (200 ms) with no edges, the speed is reported as 0.
+// This must be less than the 262 ms it takes Timer 3 to wrap around.
+#define EDGE_TIMEOUT 50000
+
+// The last A and B levels of each encoder, packed into one byte so the ISRs
+// only need a single load and store: bit 1 is A and bit 0 is B.
+static volatile uint8_t stateLeft;
+static volatile uint8_t stateRight;
+
+// The number of illegal transitions (both channels changing at once) seen by
+// each ISR.  These wrap around at 65536.
+static volatile uint16_t errorCountLeft;
+static volatile uint16_t errorCountRight;
+
+// The error counts at the last call to checkErrorLeft() or checkErrorRight().
+static uint16_t checkedErrorCountLeft;
+static uint16_t checkedErrorCountRight;
+
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+
+// Edge rate statistics.  Each ISR counts its edges within the current
+// millisecond (as given by the low byte of the Arduino millisecond counter) and
+// keeps the highest such count.
+static volatile uint8_t windowMillisLeft;
+static volatile uint8_t windowMillisRight;
+static volatile uint8_t windowEdgesLeft;
+static volatile uint8_t windowEdgesRight;
+static volatile uint8_t peakEdgesLeft;
+static volatile uint8_t peakEdgesRight;
+
+// This is the variable that millis() reads, defined in the Arduino AVR core
+// (wiring.c).  We only read its low byte, which is much cheaper than calling
+// millis() from an ISR.
+extern volatile unsigned long timer0_millis;
+
+static inline uint8_t millisLowByte() __attribute__((always_inline));
+static inline uint8_t millisLowByte()
+{
+    return *(volatile uint8_t *)&timer0_millis;
+}
+
+#endif
+
+// These count variables are uint16_t instead of int16_t because
+// signed integer overflow is undefined behavior in C++.
+static volatile uint16_t countLeft;
+static volatile uint16_t countRight;
+
+// Incremented by the encoder ISRs every time they run.  Instead of disabling
+// interrupts, code that reads more than one byte of data written by the ISRs
+// reads this before and after, and tries again if it changed.  This works
+// because the ISRs are the only writers and cannot be interrupted by the
+// reader.
+static volatile uint8_t generation;
+
+// The raw counts at the last call to getCountsAndResetLeft() or
+// getCountsAndResetRight().  The ISRs never clear the counts; resetting just
+// moves this baseline.
+static uint16_t resetBaseLeft;
+static uint16_t resetBaseRight;
+
+// Timestamps and counts recorded by the ISRs for each edge.  The head counts
+// edges and wraps around at 256; head & (EDGE_BUFFER_SIZE - 1) is the index of
+// the newest entry.
+struct EdgeRing
+{
+    uint16_t time[EDGE_BUFFER_SIZE];
+    uint16_t count[EDGE_BUFFER_SIZE];
+    uint8_t head;
+};
+
+// State kept by getSpeedLeft()/getSpeedRight() between calls.
+struct EdgeTracker
+{
+    uint8_t head;       // The ring head seen by the last call.
+    uint8_t validFrom;  // Entries older than this are too old to use.
+    uint16_t now;       // The time of the last call.
+    uint16_t idle;      // Ticks since the newest edge, saturating.
+};
+
+static volatile bool edgeTimingEnabled;
+static volatile EdgeRing edgesLeft;
+static volatile EdgeRing edgesRight;
+static EdgeTracker trackerLeft;
+static EdgeTracker trackerRight;
+
+// Reads Timer 3 from outside of an ISR.  Reading a 16-bit timer register uses
+// the TEMP register that all 16-bit timer registers share.  The encoder ISRs
+// and the Timer 3 compare ISRs used by the line sensors and the buzzer also
+// access 16-bit Timer 3 registers, and the compare ISRs do not increment
+// generation, so interrupts must be disabled during the read.
+static inline uint16_t readTimer3()
+{
+    uint8_t oldSREG = SREG;
+    cli();
+    uint16_t count = TCNT3;
+    SREG = oldSREG;
+    return count;
+}
+
+static inline void recordEdge(volatile EdgeRing & ring, uint16_t count)
+    __attribute__((always_inline));
+static inline void recordEdge(volatile EdgeRing & ring, uint16_t count)
+{
+    uint8_t i = ++ring.head & (EDGE_BUFFER_SIZE - 1);
+    ring.time[i] = TCNT3;
+    ring.count[i] = count;
+}
+
+// The raw 16-bit counts seen by the last call to getSnapshot(), and the
+// 32-bit totals that getSnapshot() accumulates from them.
+static uint16_t snapshotLastLeft;
+static uint16_t snapshotLastRight;
+static int32_t snapshotCountsLeft;
+static int32_t snapshotCountsRight;
+
+// The encoder ISRs below are written to keep the work per edge small, since
+// they can run tens of thousands of times per second at full speed: the
+// previous state is one byte, each count is loaded and stored once, and the
+// error count is only written when an error happens.
+//
+// Approximate cost per edge, in CPU cycles at 16 MHz, including the interrupt
+// response, register saving, and reti.  These were counted by hand from the
+// instructions avr-gcc -Os typically generates for this code, not measured,
+// so treat them as estimates to within about 10 cycles:
+//
+//                                      left (PCINT0)   right (INT6)
+//   original code (four bool states)        ~85            ~150
+//   this code                               ~70            ~135
+//   this code, FAST_ISR                     ~70             ~70
+//   + enableEdgeTiming()                    +20             +20
+//   + BALBOA_32U4_ENCODERS_STATISTICS       +25             +25
+//
+// Most of the right encoder's extra cost without BALBOA_32U4_ENCODERS_FAST_ISR
+// is the attachInterrupt() dispatch code in the Arduino core, which saves all
+// of the call-clobbered registers and makes an indirect call.
+
+ISR(PCINT0_vect)
+{
+    uint8_t newB = FastGPIO::Pin<LEFT_B>::isInputHigh();
+    uint8_t newA = FastGPIO::Pin<LEFT_XOR>::isInputHigh() ^ newB;
+    uint8_t newState = (newA << 1) | newB;
+    uint8_t lastState = stateLeft;
+    stateLeft = newState;
+    generation++;
+
+    uint16_t count = countLeft
+        + ((lastState >> 1) ^ newB) - (newA ^ (lastState & 1));
+    countLeft = count;
+
+    if (edgeTimingEnabled)
+    {
+        recordEdge(edgesLeft, count);
+    }
+
+    if ((lastState ^ newState) == 3)
+    {
+        errorCountLeft++;
+    }
+
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+    uint8_t ms = millisLowByte();
+    if (ms != windowMillisLeft)
+    {
+        windowMillisLeft = ms;
+        windowEdgesLeft = 0;
+    }
+    uint8_t edges = ++windowEdgesLeft;
+    if (edges > peakEdgesLeft)
+    {
+        peakEdgesLeft = edges;
+    }
+#endif
+}
+
+static inline void rightEdge() __attribute__((always_inline));
+static inline void rightEdge()
+{
+    uint8_t newB = FastGPIO::Pin<RIGHT_B>::isInputHigh();
+    uint8_t newA = FastGPIO::Pin<RIGHT_XOR>::isInputHigh() ^ newB;
+    uint8_t newState = (newA << 1) | newB;
+    uint8_t lastState = stateRight;
+    stateRight = newState;
+    generation++;
+
+    uint16_t count = countRight
+        + ((lastState >> 1) ^ newB) - (newA ^ (lastState & 1));
+    countRight = count;
+
+    if (edgeTimingEnabled)
+    {
+        recordEdge(edgesRight, count);
+    }
+
+    if ((lastState ^ newState) == 3)
+    {
+        errorCountRight++;
+    }
+
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+    uint8_t ms = millisLowByte();
+    if (ms != windowMillisRight)
+    {
+        windowMillisRight = ms;
+        windowEdgesRight = 0;
+    }
+    uint8_t edges = ++windowEdgesRight;
+    if (edges > peakEdgesRight)
+    {
+        peakEdgesRight = edges;
+    }
+#endif
+}
+
+#ifdef BALBOA_32U4_ENCODERS_FAST_ISR
+
+// Handling INT6 directly avoids the dispatch code behind attachInterrupt(),
+// which saves every call-clobbered register and makes an indirect call on
+// each edge.
+ISR(INT6_vect)
+{
+    rightEdge();
+}
+
+#else
+
+static void rightISR()
+{
+    rightEdge();
+}
+
+#endif
+
+void Balboa32U4Encoders::init2()
+{
+    // Set the pins as pulled-up inputs.
+    FastGPIO::Pin<LEFT_XOR>::setInputPulledUp();
+    FastGPIO::Pin<LEFT_B>::setInputPulledUp();
+    FastGPIO::Pin<RIGHT_XOR>::setInputPulledUp();
+    FastGPIO::Pin<RIGHT_B>::setInputPulledUp();
+
+    // Enable pin-change interrupt on PB4 for left encoder, and disable other
+    // pin-change interrupts.
+    PCICR = (1 << PCIE0);
+    PCMSK0 = (1 << PCINT4);
+    PCIFR = (1 << PCIF0);  // Clear its interrupt flag by writing a 1.
+
+#ifdef BALBOA_32U4_ENCODERS_FAST_ISR
+    // Enable interrupt on PE6 for the right encoder, triggered by any edge.
+    EICRB = (EICRB & ~(1 << ISC61)) | (1 << ISC60);
+    EIFR = (1 << INTF6);  // Clear its interrupt flag by writing a 1.
+    EIMSK |= (1 << INT6);
+#else
+    // Enable interrupt on PE6 for the right encoder.  We use attachInterrupt
+    // instead of defining ISR(INT6_vect) ourselves so that this class will be
+    // compatible with other code that uses attachInterrupt.
+    attachInterrupt(4, rightISR, CHANGE);
+#endif
+
+    // Initialize the variables.  It's good to do this after enabling the
+    // interrupts in case the interrupts fired by accident as we were enabling
+    // them.
+    uint8_t leftB = FastGPIO::Pin<LEFT_B>::isInputHigh();
+    uint8_t leftA = FastGPIO::Pin<LEFT_XOR>::isInputHigh() ^ leftB;
+    stateLeft = (leftA << 1) | leftB;
+    countLeft = 0;
+    errorCountLeft = 0;
+    checkedErrorCountLeft = 0;
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+    peakEdgesLeft = 0;
+#endif
+
+    uint8_t rightB = FastGPIO::Pin<RIGHT_B>::isInputHigh();
+    uint8_t rightA = FastGPIO::Pin<RIGHT_XOR>::isInputHigh() ^ rightB;
+    stateRight = (rightA << 1) | rightB;
+    countRight = 0;
+    errorCountRight = 0;
+    checkedErrorCountRight = 0;
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+    peakEdgesRight = 0;
+#endif
+
+    resetBaseLeft = 0;
+    resetBaseRight = 0;
+
+    snapshotLastLeft = 0;
+    snapshotLastRight = 0;
+    snapshotCountsLeft = 0;
+    snapshotCountsRight = 0;
+}
+
+// Reads a count written by the ISRs without disabling interrupts.
+static inline uint16_t readCount(volatile uint16_t & count)
+{
+    uint8_t g;
+    uint16_t c;
+    do
+    {
+        g = generation;
+        c = count;
+    } while (g != generation);
+    return c;
+}
+
+int16_t Balboa32U4Encoders::getCountsLeft()
+{
+    init();
+
+    return readCount(countLeft) - resetBaseLeft;
+}
+
+int16_t Balboa32U4Encoders::getCountsRight()
+{
+    init();
+
+    return readCount(countRight) - resetBaseRight;
+}
+
+int16_t Balboa32U4Encoders::getCountsAndResetLeft()
+{
+    init();
+
+    uint16_t raw = readCount(countLeft);
+    int16_t counts = raw - resetBaseLeft;
+    resetBaseLeft = raw;
+    return counts;
+}
+
+int16_t Balboa32U4Encoders::getCountsAndResetRight()
+{
+    init();
+
+    uint16_t raw = readCount(countRight);
+    int16_t counts = raw - resetBaseRight;
+    resetBaseRight = raw;
+    return counts;
+}
+
+Balboa32U4Encoders::Snapshot Balboa32U4Encoders::getSnapshot()
+{
+    init();
+
+    // Read both counts with no ISR in between, so they are from the same
+    // instant.
+    uint8_t g;
+    uint16_t left, right;
+    do
+    {
+        g = generation;
+        left = countLeft;
+        right = countRight;
+    } while (g != generation);
+
+    Snapshot snapshot;
+    snapshot.deltaLeft = left - snapshotLastLeft;
+    snapshot.deltaRight = right - snapshotLastRight;
+    snapshotLastLeft = left;
+    snapshotLastRight = right;
+
+    snapshotCountsLeft += snapshot.deltaLeft;
+    snapshotCountsRight += snapshot.deltaRight;
+    snapshot.countsLeft = snapshotCountsLeft;
+    snapshot.countsRight = snapshotCountsRight;
+    return snapshot;
+}
+
+void Balboa32U4Encoders::enableEdgeTiming()
+{
+    init();
+
+    if (edgeTimingEnabled) { return; }
+
+    // Timer 3 configuration
+    // prescaler: clockI/O / 64
+    // normal mode, no outputs
+    // The Timer 3 interrupts are left alone because Balboa32U4LineSensors
+    // uses a compare interrupt on this same timebase.
+    TCCR3A = 0;
+    TCCR3B = (1 << CS31) | (1 << CS30);
+
+    trackerLeft.head = trackerLeft.validFrom = edgesLeft.head;
+    trackerRight.head = trackerRight.validFrom = edgesRight.head;
+    trackerLeft.idle = trackerRight.idle = EDGE_TIMEOUT;
+    trackerLeft.now = trackerRight.now = readTimer3();
+    edgeTimingEnabled = true;
+}
+
+static int32_t edgeSpeed(volatile EdgeRing & ring, EdgeTracker & tracker)
+{
+    uint16_t time[EDGE_BUFFER_SIZE];
+    uint16_t count[EDGE_BUFFER_SIZE];
+
+    uint8_t g, head;
+    uint16_t now;
+    do
+    {
+        g = generation;
+        head = ring.head;
+        now = readTimer3();
+        for (uint8_t i = 0; i < EDGE_BUFFER_SIZE; i++)
+        {
+            time[i] = ring.time[i];
+            count[i] = ring.count[i];
+        }
+    } while (g != generation);
+
+    const uint8_t mask = EDGE_BUFFER_SIZE - 1;
+    uint16_t newestTime = time[head & mask];
+
+    // Track how long it has been since the newest edge.  Timer 3 wraps
+    // around, so we accumulate the idle time ourselves and stop trusting
+    // timestamps that are older than EDGE_TIMEOUT.
+    if (head != tracker.head)
+    {
+        if (tracker.idle >= EDGE_TIMEOUT)
+        {
+            // The edges before this batch are too old to use.
+            tracker.validFrom = tracker.head + 1;
+        }
+        tracker.head = head;
+        tracker.idle = now - newestTime;
+    }
+    else
+    {
+        uint32_t idle = (uint32_t)tracker.idle + (uint16_t)(now - tracker.now);
+        tracker.idle = idle > EDGE_TIMEOUT ? EDGE_TIMEOUT : idle;
+    }
+    tracker.now = now;
+
+    uint8_t available = head - tracker.validFrom;
+    if (available > EDGE_BUFFER_SIZE - 1)
+    {
+        available = EDGE_BUFFER_SIZE - 1;
+        tracker.validFrom = head - available;
+    }
+    if (tracker.idle >= EDGE_TIMEOUT || available == 0) { return 0; }
+
+    // Use the most recent edge period (1/T), extended to cover as many edges
+    // as fit in EDGE_WINDOW (M/T).
+    uint8_t k = 1;
+    uint16_t span = newestTime - time[(head - 1) & mask];
+    while (k < available)
+    {
+        uint16_t s = newestTime - time[(head - k - 1) & mask];
+        if (s > EDGE_WINDOW) { break; }
+        span = s;
+        k++;
+    }
+
+    int16_t edges = count[head & mask] - count[(head - k) & mask];
+    if (edges == 0 || span == 0) { return 0; }
+
+    // If we have waited longer than the average edge period, the wheel is
+    // slowing down, so estimate as if an edge were happening right now.
+    uint16_t magnitude = edges < 0 ? -edges : edges;
+    if ((uint32_t)tracker.idle * magnitude > span)
+    {
+        return (edges < 0 ? -EDGE_TICKS_PER_SECOND : EDGE_TICKS_PER_SECOND)
+            / (int32_t)tracker.idle;
+    }
+
+    return (int32_t)edges * EDGE_TICKS_PER_SECOND / span;
+}
+
+int32_t Balboa32U4Encoders::getSpeedLeft()
+{
+    return edgeSpeed(edgesLeft, trackerLeft);
+}
+
+int32_t Balboa32U4Encoders::getSpeedRight()
+{
+    return edgeSpeed(edgesRight, trackerRight);
+}
+
+bool Balboa32U4Encoders::checkErrorLeft()
+{
+    init();
+
+    uint16_t errors = readCount(errorCountLeft);
+    bool error = errors != checkedErrorCountLeft;
+    checkedErrorCountLeft = errors;
+    return error;
+}
+
+bool Balboa32U4Encoders::checkErrorRight()
+{
+    init();
+
+    uint16_t errors = readCount(errorCountRight);
+    bool error = errors != checkedErrorCountRight;
+    checkedErrorCountRight = errors;
+    return error;
+}
+
+Balboa32U4Encoders::Statistics Balboa32U4Encoders::getStatistics()
+{
+    init();
+
+    Statistics stats;
+    uint8_t g;
+    do
+    {
+        g = generation;
+        stats.errorsLeft = errorCountLeft;
+        stats.errorsRight = errorCountRight;
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+        stats.peakEdgesPerMsLeft = peakEdgesLeft;
+        stats.peakEdgesPerMsRight = peakEdgesRight;
+#endif
+    } while (g != generation);
+
+#ifdef BALBOA_32U4_ENCODERS_STATISTICS
+    // Start measuring new peaks.  If an edge happens between the read above
+    // and these writes, its effect on the peak is lost, which only matters
+    // if it would have set a new record.
+    peakEdgesLeft = 0;
+    peakEdgesRight = 0;
+#else
+    stats.peakEdgesPerMsLeft = 0;
+    stats.peakEdgesPerMsRight = 0;
+#endif
+    return stats;
+}
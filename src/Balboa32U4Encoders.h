@@ -0,0 +1,227 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4Encoders.h */
+
+#pragma once
+
+#include <stdint.h>
+
+/*! \brief Reads counts from the encoders on the Balboa 32U4.
+ *
+ * This class allows you to read counts from the encoders on the Balboa 32U4,
+ * which lets you tell how much each motor has turned and in what direction.
+ *
+ * The encoders are monitored in the background using interrupts, so your code
+ * can perform other tasks without missing encoder counts.  None of the
+ * functions in this class disable interrupts while reading the counts, so
+ * calling them often does not delay other interrupts.
+ *
+ * To read the left encoder, this class uses an interrupt service routine (ISR)
+ * for PCINT0_vect, so there will be a compile-time conflict with any other code
+ * that defines a pin-change ISR.
+ *
+ * To read the right encoder, this class calls
+ * [attachInterrupt()](http://arduino.cc/en/Reference/attachInterrupt), so there
+ * will be a compile-time conflict with any other code that defines an ISR for
+ * an external interrupt directly instead of using attachInterrupt().
+ *
+ * If you do not need to share the external interrupts with attachInterrupt(),
+ * you can define the macro `BALBOA_32U4_ENCODERS_FAST_ISR` when compiling the
+ * library (for example, by adding `-DBALBOA_32U4_ENCODERS_FAST_ISR` to
+ * `compiler.cpp.extra_flags`).  This class will then define ISR(INT6_vect)
+ * directly, which avoids the register saving and indirect function call that
+ * attachInterrupt() adds to every edge of the right encoder.  In that
+ * configuration, attachInterrupt() must not be used for any pin.
+ *
+ * If you call enableEdgeTiming(), this class also takes over Timer 3 and uses
+ * it as a free-running timebase for timestamping encoder edges.  It runs the
+ * timer in normal mode with a prescaler of 64 and does not use any Timer 3
+ * interrupts, so Balboa32U4LineSensors::startRead() can share the timer.
+ *
+ * The counts always have the full quadrature (4x) resolution: every edge of
+ * either encoder channel is counted.  On the Balboa 32U4, only the XOR of each
+ * encoder's two channels is connected to an interrupt-capable pin (the B
+ * channels are on PE2 and PF0, which have no interrupts).  Interrupting on
+ * only some of the XOR edges would make the direction of rotation ambiguous,
+ * so the interrupt rate cannot be lowered by decoding at 1x or 2x resolution.
+ * To reduce the cost of each interrupt instead, use
+ * `BALBOA_32U4_ENCODERS_FAST_ISR` as described above.
+ *
+ * The standard Balboa motors have a gear ratio of 3952:33 (approximately 120:1).
+ * The standard Balboa encoders give 12 counts per revolution.  Therefore, one
+ * revolution of a Balboa wheel corresponds to 12*3952/33 (approximately 1437.09)
+ * encoder counts as returned by this library.
+ */
+class Balboa32U4Encoders
+{
+
+public:
+
+    /*! \brief A snapshot of both encoder counts taken at the same instant.
+     *
+     * See getSnapshot(). */
+    struct Snapshot
+    {
+        /*! The accumulated count of the left-side encoder, extended to 32
+         *  bits so that it does not overflow in practice. */
+        int32_t countsLeft;
+
+        /*! The accumulated count of the right-side encoder, extended to 32
+         *  bits so that it does not overflow in practice. */
+        int32_t countsRight;
+
+        /*! The change in the left-side count since the previous snapshot. */
+        int16_t deltaLeft;
+
+        /*! The change in the right-side count since the previous snapshot. */
+        int16_t deltaRight;
+    };
+
+    /*! \brief Diagnostic counters for the encoders.
+     *
+     * See getStatistics(). */
+    struct Statistics
+    {
+        /*! The total number of errors detected on the left-side encoder (see
+         *  checkErrorLeft()).  This wraps around to 0 after 65535. */
+        uint16_t errorsLeft;
+
+        /*! The total number of errors detected on the right-side encoder. */
+        uint16_t errorsRight;
+
+        /*! The highest number of left-side encoder edges that were handled
+         *  within a single millisecond since the previous call to
+         *  getStatistics(), or 0 if `BALBOA_32U4_ENCODERS_STATISTICS` is not
+         *  defined. */
+        uint8_t peakEdgesPerMsLeft;
+
+        /*! The highest number of right-side encoder edges that were handled
+         *  within a single millisecond since the previous call to
+         *  getStatistics(). */
+        uint8_t peakEdgesPerMsRight;
+    };
+
+    /*! This function initializes the encoders if they have not been initialized
+     *  already and starts listening for counts.  This
+     *  function is called automatically whenever you call any other function in
+     *  this class, so you should not normally need to call it in your code. */
+    static void init()
+    {
+        static bool initialized = 0;
+        if (!initialized)
+        {
+            initialized = true;
+            init2();
+        }
+    }
+
+    /*! Returns the number of counts that have been detected from the left-side
+     * encoder.  These counts start at 0.  Positive counts correspond to forward
+     * movement of the left side of the Balboa, while negative counts correspond
+     * to backwards movement.
+     *
+     * The count is returned as a signed 16-bit integer.  When the count goes
+     * over 32767, it will overflow down to -32768.  When the count goes below
+     * -32768, it will overflow up to 32767. */
+    static int16_t getCountsLeft();
+
+    /*! This function is just like getCountsLeft() except it applies to the
+     *  right-side encoder. */
+    static int16_t getCountsRight();
+
+    /*! This function is just like getCountsLeft() except it also clears the
+     *  counts before returning.  If you call this frequently enough, you will
+     *  not have to worry about the count overflowing. */
+    static int16_t getCountsAndResetLeft();
+
+    /*! This function is just like getCountsAndResetLeft() except it applies to
+     *  the right-side encoder. */
+    static int16_t getCountsAndResetRight();
+
+    /*! Reads both encoders at the same instant and returns their 32-bit
+     * accumulated counts along with the change in each count since the
+     * previous call to this function.
+     *
+     * Both counters are read together, with no encoder interrupt in between,
+     * so the left and right values correspond to the same moment in time,
+     * which is useful for balancing and odometry.
+     *
+     * The 32-bit counts are maintained by this function, so it must be called
+     * at least once every 32767 counts (about 22 wheel revolutions on a
+     * standard Balboa) to keep them accurate.  Calling getCountsAndResetLeft()
+     * or getCountsAndResetRight() does not disturb them. */
+    static Snapshot getSnapshot();
+
+    /*! Starts recording the time of every encoder edge so that getSpeedLeft()
+     * and getSpeedRight() can be used.
+     *
+     * This function configures Timer 3 to run freely with a prescaler of 64
+     * (4 us per tick at 16 MHz), so it will conflict with any other code that
+     * uses Timer 3.  Each encoder ISR takes a little longer while edge timing
+     * is enabled because it stores a timestamp in a small per-wheel ring
+     * buffer. */
+    static void enableEdgeTiming();
+
+    /*! Returns the speed of the left wheel in encoder counts per second.
+     * Positive speeds correspond to forward movement.
+     *
+     * You must call enableEdgeTiming() before using this function.
+     *
+     * The speed is estimated from the timestamps of the most recent encoder
+     * edges.  At low speeds it is the reciprocal of the time between the last
+     * two edges, which is much finer than counting edges over a fixed window.
+     * At higher speeds it averages over all edges seen in the last 10 ms.  If
+     * the time since the last edge is longer than the recent edge period, the
+     * estimate decays as though an edge had just happened, so the speed goes
+     * smoothly to 0 when the wheel stops; after about 200 ms with no edges it
+     * is exactly 0.
+     *
+     * This function must be called at least every 200 ms for that
+     * timeout to work correctly. */
+    static int32_t getSpeedLeft();
+
+    /*! This function is just like getSpeedLeft() except it applies to the
+     *  right-side encoder. */
+    static int32_t getSpeedRight();
+
+    /*! This function returns true if an error was detected on the left-side
+     * encoder.  It resets the error flag automatically, so it will only return
+     * true if an error was detected since the last time checkErrorLeft() was
+     * called.
+     *
+     * If an error happens, it means that both of the encoder outputs changed at
+     * the same time from the perspective of the ISR, so the ISR was unable to
+     * tell what direction the motor was moving, and the encoder count could be
+     * inaccurate.  The most likely cause for an error is that the interrupt
+     * service routine for the encoders could not be started soon enough.  If
+     * you get encoder errors, make sure you are not disabling interrupts for
+     * extended periods of time in your code. */
+    static bool checkErrorLeft();
+
+    /*! This function is just like checkErrorLeft() except it applies to
+     *  the right-side encoder. */
+    static bool checkErrorRight();
+
+    /*! Returns counters that help you tell how well the encoder ISRs are
+     * keeping up.
+     *
+     * Unlike checkErrorLeft() and checkErrorRight(), the error totals tell you
+     * how many errors happened, not just whether any did, and they are not
+     * reset by this function or by the checkError functions.  A large number
+     * of errors during periods of heavy load suggests that other code is
+     * keeping interrupts disabled for too long.
+     *
+     * The peak edge rates are only measured if the macro
+     * `BALBOA_32U4_ENCODERS_STATISTICS` is defined when compiling the library,
+     * in the same way as `BALBOA_32U4_ENCODERS_FAST_ISR`, since measuring them
+     * adds about 25 cycles to every encoder interrupt.  Otherwise they are
+     * always 0.  They are reset each time this function is called, so you can
+     * call it periodically to see the busiest millisecond in each period.
+     * They are based on the Arduino millisecond counter, so they will be too
+     * high if something else stops the Timer 0 interrupt. */
+    static Statistics getStatistics();
+
+private:
+
+    static void init2();
+};
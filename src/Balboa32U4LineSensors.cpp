@@ -0,0 +1,842 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Arduino.h>
+#include <Balboa32U4LineSensors.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+
+// The line sensors are on PF1, PF4, PF5, PF7, and either PC6 (pin 5) or PD6
+// (pin 12) depending on the alignment.  Since the fifth sensor is always on
+// bit 6, and PF6 is not a sensor, one sample of all five sensors fits in a
+// byte: PINF ORed with bit 6 of the other port.  These tables give the bit for
+// each sensor in that byte.
+const uint8_t Balboa32U4LineSensors::centerAlignedBits[sensorCount] =
+    { 1 << 6, 1 << 1, 1 << 4, 1 << 5, 1 << 7 };  // 5, A4, A3, A2, A0
+const uint8_t Balboa32U4LineSensors::edgeAlignedBits[sensorCount] =
+    { 1 << 1, 1 << 4, 1 << 5, 1 << 7, 1 << 6 };  // A4, A3, A2, A0, 12
+
+// The Arduino core runs Timer 0 with a prescaler of 64, so its counter
+// increments every 4 us.
+#define TIMER0_US_PER_TICK 4
+
+// The format of the calibration record in EEPROM.  Change the version number
+// if the format changes so that old records are not misinterpreted.
+#define CALIBRATION_RECORD_MAGIC 0xB5
+#define CALIBRATION_RECORD_VERSION 1
+
+struct CalibrationRecord
+{
+    uint8_t magic;
+    uint8_t version;
+    uint8_t alignment;
+    uint8_t type;
+    uint8_t sensorCount;
+    uint8_t initialized;  // bit 0: calibrationOn, bit 1: calibrationOff
+    uint16_t timeout;
+    uint16_t onMinimum[5];
+    uint16_t onMaximum[5];
+    uint16_t offMinimum[5];
+    uint16_t offMaximum[5];
+    uint16_t crc;  // CRC-16 of all of the bytes above
+};
+
+static_assert(sizeof(CalibrationRecord) == Balboa32U4LineSensors::calibrationRecordSize,
+    "calibrationRecordSize does not match the record format.");
+
+static uint16_t calibrationRecordCrc(const CalibrationRecord & record)
+{
+    const uint8_t * bytes = (const uint8_t *)&record;
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < offsetof(CalibrationRecord, crc); i++)
+    {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+Balboa32U4LineSensors::Balboa32U4LineSensors()
+{
+    setTypeRC();
+
+    calibrationOn.minimum = calibrationOnMinimum;
+    calibrationOn.maximum = calibrationOnMaximum;
+    calibrationOff.minimum = calibrationOffMinimum;
+    calibrationOff.maximum = calibrationOffMaximum;
+}
+
+Balboa32U4LineSensors::~Balboa32U4LineSensors()
+{
+    // The calibration arrays are part of this object, so keep the QTRSensors
+    // destructor from trying to free them.
+    calibrationOn.minimum = calibrationOn.maximum = nullptr;
+    calibrationOff.minimum = calibrationOff.maximum = nullptr;
+}
+
+void Balboa32U4LineSensors::setAlignment(Alignment newAlignment)
+{
+    alignment = newAlignment;
+
+    // The sensors are in a different order now, so any previous calibration
+    // values are no longer valid.
+    calibrationOn.initialized = false;
+    calibrationOff.initialized = false;
+    ambientCallsLeft = 0;
+    updateCalibrationScaling();
+}
+
+void Balboa32U4LineSensors::setSensorPins(const uint8_t * pins, uint8_t count)
+{
+    static const uint8_t centerAlignedPins[sensorCount] = { 5, A4, A3, A2, A0 };
+    static const uint8_t edgeAlignedPins[sensorCount] = { A4, A3, A2, A0, 12 };
+
+    Alignment newAlignment = Alignment::None;
+    if (count == sensorCount && memcmp(pins, centerAlignedPins, sensorCount) == 0)
+    {
+        newAlignment = Alignment::Center;
+    }
+    else if (count == sensorCount && memcmp(pins, edgeAlignedPins, sensorCount) == 0)
+    {
+        newAlignment = Alignment::Edge;
+    }
+    setAlignment(newAlignment);
+}
+
+void Balboa32U4LineSensors::setTimeout(uint16_t timeout)
+{
+    QTRSensors::setTimeout(timeout);
+    ambientCallsLeft = 0;
+    updateCalibrationScaling();
+}
+
+void Balboa32U4LineSensors::read(uint16_t * sensorValues, QTRReadMode mode)
+{
+    if (alignment == Alignment::None) { return; }
+
+    switch (mode)
+    {
+    case QTRReadMode::Off:
+        emittersOff();
+        // fall through
+    case QTRReadMode::Manual:
+        readPrivate(sensorValues);
+        return;
+
+    case QTRReadMode::OnAndOff:
+        if (ambientRefreshInterval)
+        {
+            readOnAndCachedOff(sensorValues);
+            return;
+        }
+        // fall through
+    case QTRReadMode::On:
+        emittersOn();
+        readPrivate(sensorValues);
+        emittersOff();
+        break;
+
+    case QTRReadMode::OddEven:
+    case QTRReadMode::OddEvenAndOff:
+        emittersSelect(QTREmitters::Odd);
+        readPrivate(sensorValues, 0, 2);
+        emittersSelect(QTREmitters::Even);
+        readPrivate(sensorValues, 1, 2);
+        emittersOff();
+        break;
+
+    default:
+        return;
+    }
+
+    if (mode == QTRReadMode::OnAndOff || mode == QTRReadMode::OddEvenAndOff)
+    {
+        uint16_t offValues[sensorCount];
+        readPrivate(offValues);
+        combineOnAndOff(sensorValues, offValues);
+    }
+}
+
+void Balboa32U4LineSensors::readPrivate(uint16_t * sensorValues, uint8_t start, uint8_t step)
+{
+    if (alignment == Alignment::Edge)
+    {
+        readRCFast<true>(sensorValues, start, step);
+    }
+    else
+    {
+        readRCFast<false>(sensorValues, start, step);
+    }
+}
+
+template <bool edgeAligned>
+void Balboa32U4LineSensors::readRCFast(uint16_t * sensorValues, uint8_t start, uint8_t step)
+{
+    const uint8_t * bits = edgeAligned ? edgeAlignedBits : centerAlignedBits;
+    volatile uint8_t & otherPin = edgeAligned ? PIND : PINC;
+    volatile uint8_t & otherPort = edgeAligned ? PORTD : PORTC;
+    volatile uint8_t & otherDdr = edgeAligned ? DDRD : DDRC;
+
+    const uint16_t timeout = getTimeout();
+
+    uint8_t mask = 0;
+    for (uint8_t i = start; i < sensorCount; i += step)
+    {
+        sensorValues[i] = timeout;
+        mask |= bits[i];
+    }
+    const uint8_t maskF = mask & ~(1 << 6);
+    const uint8_t maskOther = mask & (1 << 6);
+
+    // Drive the sensor lines high to charge the sensors.  Interrupts are
+    // disabled because these read-modify-write sequences are not atomic.
+    uint8_t sreg = SREG;
+    cli();
+    PORTF |= maskF;
+    DDRF |= maskF;
+    otherPort |= maskOther;
+    otherDdr |= maskOther;
+    SREG = sreg;
+
+    delayMicroseconds(10);
+
+    // Switch all the lines to inputs (without pull-ups) at the same time as
+    // we record the start time.
+    cli();
+    uint8_t lastCount = TCNT0;
+    DDRF &= ~maskF;
+    PORTF &= ~maskF;
+    otherDdr &= ~maskOther;
+    otherPort &= ~maskOther;
+    SREG = sreg;
+
+    // Time is tracked in Timer 0 ticks by adding up the changes in the 8-bit
+    // counter, which works as long as each pass of the loop takes less than
+    // 1 ms.  Stopping when ticks reaches timeoutTicks guarantees that every
+    // time we record is less than the timeout.
+    const uint16_t timeoutTicks = (timeout + TIMER0_US_PER_TICK - 1) / TIMER0_US_PER_TICK;
+    uint16_t ticks = 0;
+    uint8_t pending = mask;
+
+    while (true)
+    {
+        // Read the time and all of the sensors with interrupts disabled so
+        // that the sample is not delayed after the time is read.
+        cli();
+        uint8_t count = TCNT0;
+        uint8_t state = (PINF & maskF) | (otherPin & maskOther);
+        SREG = sreg;
+
+        ticks += (uint8_t)(count - lastCount);
+        lastCount = count;
+        if (ticks >= timeoutTicks) { break; }
+
+        uint8_t low = pending & ~state;
+        if (low)
+        {
+            // Record the first time each of these lines read low.
+            pending &= ~low;
+            uint16_t time = ticks * TIMER0_US_PER_TICK;
+            for (uint8_t i = start; i < sensorCount; i += step)
+            {
+                if (low & bits[i]) { sensorValues[i] = time; }
+            }
+
+            // Stop early once every sensor has discharged.
+            if (!pending) { break; }
+        }
+    }
+
+    lastReadDuration = ticks * TIMER0_US_PER_TICK;
+}
+
+void Balboa32U4LineSensors::readOnAndCachedOff(uint16_t * sensorValues)
+{
+    if (ambientCallsLeft == 0)
+    {
+        if (ambientSettling)
+        {
+            // The previous call turned the emitters off without waiting.
+            // Make sure they have had time to turn off; usually this has
+            // already passed.  (Driver min is 1 ms for dimmable emitters.)
+            uint16_t offTime = getDimmable() ? 1200 : 200;
+            while ((uint16_t)(micros() - ambientOffStart) < offTime)
+            {
+                delayMicroseconds(10);
+            }
+            ambientSettling = false;
+        }
+
+        // This only waits if the emitters were on, such as on the first call
+        // or if they were turned on since the previous call.
+        emittersOff();
+        readPrivate(ambientValues);
+        ambientCallsLeft = ambientRefreshInterval;
+    }
+
+    // The emitters are left on between calls, so they only need to be turned
+    // on (and waited for) after the ambient readings.  Turning on dimmable
+    // emitters that are already on would make us wait for them to turn off
+    // first.
+    if (!emittersAreOn()) { emittersOn(); }
+    readPrivate(sensorValues);
+
+    if (--ambientCallsLeft == 0)
+    {
+        // Start turning the emitters off for the next ambient readings, and
+        // let the caller do something useful while they turn off.
+        emittersOff(QTREmitters::All, false);
+        ambientOffStart = micros();
+        ambientSettling = true;
+    }
+
+    combineOnAndOff(sensorValues, ambientValues);
+}
+
+void Balboa32U4LineSensors::combineOnAndOff(uint16_t * sensorValues, const uint16_t * offValues)
+{
+    const uint16_t maxValue = getTimeout();
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        sensorValues[i] += maxValue - offValues[i];
+        if (sensorValues[i] > maxValue)
+        {
+            // This usually doesn't happen, because the sensor reading should
+            // go up when the emitters are turned off.
+            sensorValues[i] = maxValue;
+        }
+    }
+}
+
+// Returns true if all of the emitters are on (or there are no emitter pins).
+bool Balboa32U4LineSensors::emittersAreOn()
+{
+    if (getOddEmitterPin() != QTRNoEmitterPin && digitalRead(getOddEmitterPin()) == LOW)
+    {
+        return false;
+    }
+
+    if (getEmitterPinCount() == 2 && getEvenEmitterPin() != QTRNoEmitterPin &&
+        digitalRead(getEvenEmitterPin()) == LOW)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void Balboa32U4LineSensors::calibrate(QTRReadMode mode)
+{
+    // Manual emitter control is not supported, and there is nothing to read
+    // before the alignment is set.
+    if (mode == QTRReadMode::Manual || alignment == Alignment::None) { return; }
+
+    if (mode == QTRReadMode::On || mode == QTRReadMode::OnAndOff)
+    {
+        calibrateOnOrOff(calibrationOn, QTRReadMode::On);
+    }
+    else if (mode == QTRReadMode::OddEven || mode == QTRReadMode::OddEvenAndOff)
+    {
+        calibrateOnOrOff(calibrationOn, QTRReadMode::OddEven);
+    }
+
+    if (mode == QTRReadMode::OnAndOff || mode == QTRReadMode::OddEvenAndOff ||
+        mode == QTRReadMode::Off)
+    {
+        calibrateOnOrOff(calibrationOff, QTRReadMode::Off);
+    }
+}
+
+void Balboa32U4LineSensors::calibrateOnOrOff(CalibrationData & calibration, QTRReadMode mode)
+{
+    uint16_t sensorValues[sensorCount];
+    uint16_t maxSensorValues[sensorCount];
+    uint16_t minSensorValues[sensorCount];
+
+    if (!calibration.initialized)
+    {
+        // Initialize the limits so that the first reading will update them.
+        for (uint8_t i = 0; i < sensorCount; i++)
+        {
+            calibration.maximum[i] = 0;
+            calibration.minimum[i] = getTimeout();
+        }
+        calibration.initialized = true;
+    }
+
+    for (uint8_t j = 0; j < 10; j++)
+    {
+        read(sensorValues, mode);
+
+        for (uint8_t i = 0; i < sensorCount; i++)
+        {
+            if (j == 0 || sensorValues[i] > maxSensorValues[i])
+            {
+                maxSensorValues[i] = sensorValues[i];
+            }
+            if (j == 0 || sensorValues[i] < minSensorValues[i])
+            {
+                minSensorValues[i] = sensorValues[i];
+            }
+        }
+    }
+
+    // Only move a limit if all 10 readings were beyond it.
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        if (minSensorValues[i] > calibration.maximum[i])
+        {
+            calibration.maximum[i] = minSensorValues[i];
+        }
+        if (maxSensorValues[i] < calibration.minimum[i])
+        {
+            calibration.minimum[i] = maxSensorValues[i];
+        }
+    }
+
+    updateCalibrationScaling();
+}
+
+void Balboa32U4LineSensors::resetCalibration()
+{
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        calibrationOn.maximum[i] = 0;
+        calibrationOff.maximum[i] = 0;
+        calibrationOn.minimum[i] = getTimeout();
+        calibrationOff.minimum[i] = getTimeout();
+    }
+    updateCalibrationScaling();
+}
+
+void Balboa32U4LineSensors::readCalibrated(uint16_t * sensorValues, QTRReadMode mode)
+{
+    // manual emitter control is not supported
+    if (mode == QTRReadMode::Manual) { return; }
+
+    // If not calibrated, do nothing.
+    if (mode == QTRReadMode::On || mode == QTRReadMode::OddEven ||
+        mode == QTRReadMode::OnAndOff || mode == QTRReadMode::OddEvenAndOff)
+    {
+        if (!calibrationOn.initialized) { return; }
+    }
+    if (mode == QTRReadMode::Off ||
+        mode == QTRReadMode::OnAndOff || mode == QTRReadMode::OddEvenAndOff)
+    {
+        if (!calibrationOff.initialized) { return; }
+    }
+
+    // Recompute the scaling if the calibration or the mode changed.  The
+    // odd/even modes use the same calibration values as the corresponding
+    // modes that read all sensors at once.
+    QTRReadMode newScalingMode = mode;
+    if (mode == QTRReadMode::OddEven) { newScalingMode = QTRReadMode::On; }
+    else if (mode == QTRReadMode::OddEvenAndOff) { newScalingMode = QTRReadMode::OnAndOff; }
+
+    if (newScalingMode != scalingMode) { updateScaling(newScalingMode); }
+
+    read(sensorValues, mode);
+
+    if (autoCalibrationShift && scalingMode != QTRReadMode::OnAndOff)
+    {
+        trackCalibration(sensorValues, scalingMode);
+    }
+
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        uint16_t value = sensorValues[i];
+
+        if (value <= scaleOffset[i])
+        {
+            value = 0;
+        }
+        else
+        {
+            value -= scaleOffset[i];
+            if (value >= scaleRange[i])
+            {
+                value = 1000;
+            }
+            else
+            {
+                // value < range, so this product is less than 2^32 and the
+                // result is at most 1000.
+                value = ((uint32_t)value * scale[i]) >> 16;
+            }
+        }
+
+        sensorValues[i] = value;
+    }
+}
+
+void Balboa32U4LineSensors::updateScaling(QTRReadMode mode)
+{
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        updateSensorScaling(mode, i);
+    }
+    scalingMode = mode;
+}
+
+void Balboa32U4LineSensors::updateSensorScaling(QTRReadMode mode, uint8_t i)
+{
+    const uint16_t maxValue = getTimeout();
+    uint16_t calmin, calmax;
+
+    if (mode == QTRReadMode::On)
+    {
+        calmax = calibrationOn.maximum[i];
+        calmin = calibrationOn.minimum[i];
+    }
+    else if (mode == QTRReadMode::Off)
+    {
+        calmax = calibrationOff.maximum[i];
+        calmin = calibrationOff.minimum[i];
+    }
+    else // QTRReadMode::OnAndOff
+    {
+        // An off value below the on value means there is no meaningful
+        // signal.  Otherwise, these do not go past maxValue.
+        calmin = (calibrationOff.minimum[i] < calibrationOn.minimum[i]) ? maxValue :
+            calibrationOn.minimum[i] + maxValue - calibrationOff.minimum[i];
+        calmax = (calibrationOff.maximum[i] < calibrationOn.maximum[i]) ? maxValue :
+            calibrationOn.maximum[i] + maxValue - calibrationOff.maximum[i];
+    }
+
+    if (calmax > calmin)
+    {
+        // The scale is 1000/range as a fixed-point number with 16 fractional
+        // bits, rounded up so that readings that should give a whole number
+        // are not rounded down.
+        uint16_t range = calmax - calmin;
+        scaleOffset[i] = calmin;
+        scaleRange[i] = range;
+        scale[i] = ((uint32_t)1000 << 16) / range + 1;
+    }
+    else
+    {
+        // An empty or inverted calibration range has no meaningful signal, so
+        // it always reads as 0.
+        scaleOffset[i] = 0xFFFF;
+        scaleRange[i] = 0xFFFF;
+        scale[i] = 0;
+    }
+}
+
+void Balboa32U4LineSensors::setAutoCalibration(bool enabled, uint8_t decayShift)
+{
+    if (decayShift < 1) { decayShift = 1; }
+    if (decayShift > 15) { decayShift = 15; }
+    autoCalibrationShift = enabled ? decayShift : 0;
+}
+
+void Balboa32U4LineSensors::setAmbientRefreshInterval(uint8_t interval)
+{
+    ambientRefreshInterval = interval;
+    if (interval == 0 || ambientCallsLeft > interval) { ambientCallsLeft = 0; }
+}
+
+void Balboa32U4LineSensors::trackCalibration(const uint16_t * sensorValues, QTRReadMode mode)
+{
+    CalibrationData & calibration =
+        (mode == QTRReadMode::Off) ? calibrationOff : calibrationOn;
+
+    // the closest the limits are allowed to get to each other
+    const uint16_t minRange = getTimeout() >> 4;
+
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        uint16_t value = sensorValues[i];
+        uint16_t calmin = calibration.minimum[i];
+        uint16_t calmax = calibration.maximum[i];
+
+        // Let the limit nearer to the reading decay toward it by a small
+        // fraction of the range (at least 1), without moving past the reading
+        // or getting closer than minRange to the other limit.  Only that limit
+        // moves, so a sensor that has not seen the line for a while keeps the
+        // maximum it saw over the line instead of shrinking its range until it
+        // amplifies noise.  A reading outside the limits stops the decay but
+        // does not move the limit here; that is done below, a quarter at a
+        // time, so one outlier cannot pull a limit all the way out.
+        if (calmax > calmin + minRange)
+        {
+            uint16_t step = (calmax - calmin) >> autoCalibrationShift;
+            if (step == 0) { step = 1; }
+
+            if ((uint32_t)value * 2 >= (uint32_t)calmin + calmax)
+            {
+                uint16_t newMax = calmax - step;
+                if (newMax < value) { newMax = (value < calmax) ? value : calmax; }
+                if (newMax < calmin + minRange) { newMax = calmin + minRange; }
+                calmax = newMax;
+            }
+            else
+            {
+                uint16_t newMin = calmin + step;
+                if (newMin > value) { newMin = (value > calmin) ? value : calmin; }
+                if (newMin + minRange > calmax) { newMin = calmax - minRange; }
+                calmin = newMin;
+            }
+        }
+
+        // Readings outside the limits push them a quarter of the way out
+        // (rounding up so that they always move).
+        if (value > calmax)
+        {
+            calmax += (value - calmax + 3) >> 2;
+        }
+        else if (value < calmin)
+        {
+            calmin -= (calmin - value + 3) >> 2;
+        }
+
+        calibration.minimum[i] = calmin;
+        calibration.maximum[i] = calmax;
+    }
+
+    // Refresh one sensor's scale factor per call so that this stays cheap.
+    uint8_t next = autoCalibrationNext;
+    if (next >= sensorCount) { next = 0; }
+    updateSensorScaling(mode, next);
+    autoCalibrationNext = next + 1;
+}
+
+uint16_t Balboa32U4LineSensors::readLinePrivate(uint16_t * sensorValues,
+    QTRReadMode mode, bool invertReadings)
+{
+    bool onLine = false;
+    uint32_t avg = 0;  // the weighted total
+    uint16_t sum = 0;  // the denominator, which is at most 5000
+
+    // manual emitter control is not supported
+    if (mode == QTRReadMode::Manual) { return 0; }
+
+    readCalibrated(sensorValues, mode);
+
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+        uint16_t value = sensorValues[i];
+        if (invertReadings) { value = 1000 - value; }
+
+        // keep track of whether we see the line at all
+        if (value > 200) { onLine = true; }
+
+        // only average in values that are above a noise threshold
+        if (value > 50)
+        {
+            avg += (uint32_t)value * (i * 1000);
+            sum += value;
+        }
+    }
+
+    if (!onLine)
+    {
+        // If it last read to the left of center, return 0; otherwise, return
+        // the max.
+        return (lastPosition < (sensorCount - 1) * 1000 / 2) ? 0 : (sensorCount - 1) * 1000;
+    }
+
+    lastPosition = avg / sum;
+    return lastPosition;
+}
+
+// Returns the calibrated reading for sensor i, inverted for a white line.
+static int16_t lineReading(const uint16_t * sensorValues, uint8_t i, bool whiteLine)
+{
+    uint16_t value = sensorValues[i];
+    if (value > 1000) { value = 1000; }
+    return whiteLine ? 1000 - value : value;
+}
+
+uint16_t Balboa32U4LineSensors::readLineEstimatePrivate(uint16_t * sensorValues,
+    LineEstimate & estimate, QTRReadMode mode, bool invertReadings)
+{
+    // manual emitter control is not supported
+    if (mode == QTRReadMode::Manual)
+    {
+        estimate = LineEstimate();
+        return 0;
+    }
+
+    readCalibrated(sensorValues, mode);
+    return estimateLine(sensorValues, estimate, invertReadings);
+}
+
+uint16_t Balboa32U4LineSensors::estimateLine(const uint16_t * sensorValues,
+    LineEstimate & estimate, bool whiteLine)
+{
+    const uint16_t maxPosition = (sensorCount - 1) * 1000;
+
+    estimate.segmentCount = 0;
+    estimate.confidence = 0;
+
+    // Find the segments (runs of sensors above the line threshold) and choose
+    // the one whose peak is closest to the last position.
+    uint8_t bestPeak = 0;
+    uint8_t bestPeakEnd = 0;
+    uint8_t bestStart = 0;
+    uint8_t bestEnd = 0;
+    uint16_t bestDistance = 0xFFFF;
+
+    uint8_t i = 0;
+    while (i < sensorCount)
+    {
+        if (lineReading(sensorValues, i, whiteLine) <= 200)
+        {
+            i++;
+            continue;
+        }
+
+        uint8_t start = i;
+        uint8_t peak = i;
+        uint8_t peakEnd = i;  // end of the run of sensors with the peak value
+        int16_t peakValue = 0;
+        uint16_t width = 0;
+        while (i < sensorCount)
+        {
+            int16_t value = lineReading(sensorValues, i, whiteLine);
+            if (value <= 200) { break; }
+            width += value;
+            if (value > peakValue)
+            {
+                peak = peakEnd = i;
+                peakValue = value;
+            }
+            else if (value == peakValue && i == peakEnd + 1)
+            {
+                // Only extend the peak over adjacent equal readings (a
+                // saturated plateau); an equal reading after a dip starts a
+                // separate peak and the first one is kept.
+                peakEnd = i;
+            }
+            i++;
+        }
+
+        if (estimate.segmentCount < maxLineSegments)
+        {
+            estimate.segmentWidths[estimate.segmentCount] = width;
+        }
+        estimate.segmentCount++;
+
+        uint16_t peakPosition = (peak + peakEnd) * 500;
+        uint16_t distance = (peakPosition > lastPosition) ?
+            peakPosition - lastPosition : lastPosition - peakPosition;
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            bestPeak = peak;
+            bestPeakEnd = peakEnd;
+            bestStart = start;
+            bestEnd = i;
+        }
+    }
+
+    if (estimate.segmentCount == 0)
+    {
+        // If it last read to the left of center, return 0; otherwise, return
+        // the max.
+        estimate.position = (lastPosition < maxPosition / 2) ? 0 : maxPosition;
+        return estimate.position;
+    }
+
+    // Fit a parabola through the peak and its neighbors (treating readings
+    // beyond the ends of the array as 0).  Its vertex is offset from the peak
+    // by (left - right) / (2 * (left - 2 * peak + right)) sensor spacings,
+    // which is between -1/2 and 1/2 because the peak is the highest of the
+    // three.  If several adjacent sensors share the peak value (usually
+    // because a wide line saturates them), the middle of that plateau is used
+    // as the peak.
+    int16_t peakValue = lineReading(sensorValues, bestPeak, whiteLine);
+    int16_t left = (bestPeak > 0) ? lineReading(sensorValues, bestPeak - 1, whiteLine) : 0;
+    int16_t right = (bestPeakEnd + 1 < sensorCount) ?
+        lineReading(sensorValues, bestPeakEnd + 1, whiteLine) : 0;
+    int16_t curvature = left - 2 * peakValue + right;
+
+    int32_t position = (int32_t)(bestPeak + bestPeakEnd) * 500;
+    if (curvature != 0)
+    {
+        position += (int32_t)500 * (left - right) / curvature;
+    }
+    if (position < 0) { position = 0; }
+    else if (position > maxPosition) { position = maxPosition; }
+
+    // The confidence is how much the peak stands out above everything outside
+    // of the chosen segment.
+    int16_t background = 0;
+    for (i = 0; i < sensorCount; i++)
+    {
+        if (i >= bestStart && i < bestEnd) { continue; }
+        int16_t value = lineReading(sensorValues, i, whiteLine);
+        if (value > background) { background = value; }
+    }
+    estimate.confidence = (peakValue > background) ? peakValue - background : 0;
+
+    lastPosition = position;
+    estimate.position = position;
+    return position;
+}
+
+bool Balboa32U4LineSensors::saveCalibration(uint16_t address)
+{
+    if (alignment == Alignment::None) { return false; }
+
+    // A record without any calibration would make loadCalibration() succeed
+    // without giving readCalibrated() anything to use.
+    if (!calibrationOn.initialized && !calibrationOff.initialized) { return false; }
+
+    CalibrationRecord record;
+    record.magic = CALIBRATION_RECORD_MAGIC;
+    record.version = CALIBRATION_RECORD_VERSION;
+    record.alignment = (uint8_t)alignment;
+    record.type = (uint8_t)getType();
+    record.sensorCount = 5;
+    record.initialized = calibrationOn.initialized | (calibrationOff.initialized << 1);
+    record.timeout = getTimeout();
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        record.onMinimum[i] = calibrationOn.minimum[i];
+        record.onMaximum[i] = calibrationOn.maximum[i];
+        record.offMinimum[i] = calibrationOff.minimum[i];
+        record.offMaximum[i] = calibrationOff.maximum[i];
+    }
+    record.crc = calibrationRecordCrc(record);
+
+    eeprom_update_block(&record, (void *)(uintptr_t)address, sizeof(record));
+    return true;
+}
+
+bool Balboa32U4LineSensors::loadCalibration(uint16_t address)
+{
+    if (alignment == Alignment::None) { return false; }
+
+    CalibrationRecord record;
+    eeprom_read_block(&record, (const void *)(uintptr_t)address, sizeof(record));
+
+    if (record.magic != CALIBRATION_RECORD_MAGIC ||
+        record.version != CALIBRATION_RECORD_VERSION ||
+        record.crc != calibrationRecordCrc(record))
+    {
+        return false;
+    }
+
+    if (record.alignment != (uint8_t)alignment ||
+        record.type != (uint8_t)getType() ||
+        record.sensorCount != 5 ||
+        (record.initialized & 3) == 0)
+    {
+        return false;
+    }
+
+    setTimeout(record.timeout);
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        calibrationOn.minimum[i] = record.onMinimum[i];
+        calibrationOn.maximum[i] = record.onMaximum[i];
+        calibrationOff.minimum[i] = record.offMinimum[i];
+        calibrationOff.maximum[i] = record.offMaximum[i];
+    }
+    calibrationOn.initialized = record.initialized & 1;
+    calibrationOff.initialized = record.initialized >> 1 & 1;
+    updateCalibrationScaling();
+    return true;
+}
@@ -0,0 +1,519 @@
+/** \file Balboa32U4LineSensors.h **/
+
+#pragma once
+
+#include <QTRSensors.h>
+
+/** \brief Gets readings from the five line sensors on the reflectance sensor
+ * array.
+ *
+ * Before using the sensors with this class, you must call either
+ * setCenterAligned() or setEdgeAligned() depending on the way your sensor
+ * array is mounted on the Balboa. See the [product page for the sensor
+ * array](https://www.pololu.com/product/3577) for an explanation and pictures
+ * of the two options.
+ *
+ * If the alignment is set appropriately with one of the above functions, the
+ * readLineBlack() and readLineWhite() methods will always return values that
+ * increase from left to right, with 0 corresponding to the leftmost sensor and
+ * 4000 corresponding to the rightmost sensor. (Note that “forward” refers to
+ * the rotation direction that would cause a balancing Balboa to move in the
+ * direction its battery cover is facing, and left and right are defined
+ * accordingly.)
+ *
+ * See the [Usage Notes in the QTRSensors
+ * documentation](https://pololu.github.io/qtr-sensors-arduino/md_usage.html)
+ * for an overview of how the methods from the QTRSensors library can be used
+ * and some example code.
+ *
+ * This class replaces the reading and calibration functions of QTRSensors
+ * with versions that take advantage of knowing the sensor pins in advance:
+ *
+ * - read() reads all five sensors at once from two port input registers in
+ *   each pass of its timing loop instead of calling digitalRead() for each
+ *   sensor, so it notices the end of each sensor's discharge sooner and uses
+ *   much less CPU time per pass.  It stops as soon as every sensor has
+ *   discharged instead of always waiting for the timeout (see
+ *   getLastReadDuration()).  It measures time with the Timer 0 counter that
+ *   the Arduino core uses for micros(), so it does not reconfigure any
+ *   timers.
+ * - readCalibrated() uses a precomputed fixed-point scale factor for each
+ *   sensor instead of a division, and can optionally keep adjusting the
+ *   calibration as it reads (see setAutoCalibration()).
+ * - estimateLine() and the readLineBlack() and readLineWhite() overloads
+ *   that take a LineEstimate give a smoother line position along with the
+ *   number of line segments and a confidence value.
+ * - With setAmbientRefreshInterval(), QTRReadMode::OnAndOff can reuse its
+ *   readings with the emitters off for several calls, which makes most calls
+ *   about twice as fast.
+ *
+ * This class inherits privately from QTRSensors and makes the QTRSensors
+ * functions that it does not replace public again, so it has the same
+ * functions as before, but it cannot be used through a pointer or reference
+ * to QTRSensors.  The QTRSensors versions of the reading and calibration
+ * functions would try to free or reallocate the calibration arrays, which are
+ * part of this object.
+ *
+ * This class can also read the sensors in the background with startRead(),
+ * isReadComplete(), and getValues().  See startRead() for details.
+ *
+ * The calibration values and scale factors are stored inside the object, so
+ * this class does not use any heap memory.  getRamFootprint() returns the
+ * number of bytes it uses.
+ *
+ * The calibration can be saved to EEPROM with saveCalibration() and restored
+ * after a reset with loadCalibration(), so you do not need to calibrate the
+ * sensors every time the robot is turned on:
+ *
+ * ~~~{.cpp}
+ * lineSensors.setCenterAligned();
+ * if (!lineSensors.loadCalibration())
+ * {
+ *   // Sweep the sensors over the line while calling calibrate(), then:
+ *   lineSensors.saveCalibration();
+ * }
+ * ~~~
+ */
+class Balboa32U4LineSensors : private QTRSensors
+{
+public:
+
+    using QTRSensors::setTypeRC;
+    using QTRSensors::getType;
+    using QTRSensors::getTimeout;
+    using QTRSensors::setSamplesPerSensor;
+    using QTRSensors::getSamplesPerSensor;
+    using QTRSensors::setEmitterPin;
+    using QTRSensors::setEmitterPins;
+    using QTRSensors::releaseEmitterPins;
+    using QTRSensors::getEmitterPinCount;
+    using QTRSensors::getEmitterPin;
+    using QTRSensors::getOddEmitterPin;
+    using QTRSensors::getEvenEmitterPin;
+    using QTRSensors::setDimmable;
+    using QTRSensors::setNonDimmable;
+    using QTRSensors::getDimmable;
+    using QTRSensors::setDimmingLevel;
+    using QTRSensors::getDimmingLevel;
+    using QTRSensors::emittersOff;
+    using QTRSensors::emittersOn;
+    using QTRSensors::emittersSelect;
+    using QTRSensors::CalibrationData;
+    using QTRSensors::calibrationOn;
+    using QTRSensors::calibrationOff;
+
+    /** \brief Sets the sensor type to analog.  See
+     * QTRSensors::setTypeAnalog().
+     *
+     * The sensors on the array are RC sensors, and the reading functions of
+     * this class always read them that way, so this only changes getType()
+     * and the type stored by saveCalibration(). */
+    using QTRSensors::setTypeAnalog;
+
+    /** \brief The number of sensors on the array. */
+    static const uint8_t sensorCount = 5;
+
+    /** \brief The maximum number of line segment widths stored in a
+     * LineEstimate. */
+    static const uint8_t maxLineSegments = 4;
+
+    /** \brief Describes the line under the sensors in more detail than a
+     * single position.
+     *
+     * See estimateLine(). */
+    struct LineEstimate
+    {
+        /** The estimated line position, from 0 to 4000, on the same scale as
+         *  the value returned by readLineBlack(). */
+        uint16_t position;
+
+        /** The number of separate line segments seen: groups of adjacent
+         *  sensors that are over a line.  0 means that no line was seen, 1 is
+         *  a normal line, and more than 1 means something like a fork or a
+         *  parallel line. */
+        uint8_t segmentCount;
+
+        /** The width of each segment in thousandths of the sensor spacing
+         *  (the sum of the calibrated values of its sensors).  Only the first
+         *  #maxLineSegments segments, from sensor 0 upwards, are stored. */
+        uint16_t segmentWidths[maxLineSegments];
+
+        /** How sure the estimate is, from 0 to 1000: the peak value of the
+         *  segment used for the position minus the highest value outside of
+         *  it.  This is low when the line is faint or when there is another
+         *  line or noise nearby, and 0 when no line was seen. */
+        uint16_t confidence;
+    };
+
+    Balboa32U4LineSensors();
+
+    ~Balboa32U4LineSensors();
+
+    /** \brief Returns the amount of RAM used by an object of this class, in
+     * bytes.
+     *
+     * Since this class does not use the heap, this is all of the RAM used by
+     * each object. */
+    static constexpr uint16_t getRamFootprint() { return sizeof(Balboa32U4LineSensors); }
+
+    /** \brief Configures this object to use a center-aligned sensor array.
+     *
+     * This function configures this object to interface with a reflectance
+     * sensor array using the center-aligned mounting option. In this
+     * configuration, S5 is on the left side of the Balboa, S1 is on the right,
+     * and CTRL is connected to pin 12. */
+    void setCenterAligned()
+    {
+        setAlignment(Alignment::Center);
+        setEmitterPin(12);
+    }
+
+    /** \brief Configures this object to use a center-aligned sensor array.
+     *
+     * This function configures this object to interface with a reflectance
+     * sensor array using the center-aligned mounting option. In this
+     * configuration, S1 is on the left side of the Balboa, S5 is on the right,
+     * and CTRL is connected to pin 5. */
+    void setEdgeAligned()
+    {
+        setAlignment(Alignment::Edge);
+        setEmitterPin(5);
+    }
+
+    /** \brief Sets the sensor pins.  See QTRSensors::setSensorPins().
+     *
+     * The sensors are on fixed pins, so the only pin lists that this class can
+     * read are the ones used by the two alignments: `{ 5, A4, A3, A2, A0 }`
+     * for a center-aligned array and `{ A4, A3, A2, A0, 12 }` for an
+     * edge-aligned one.  Passing one of those is the same as calling
+     * setCenterAligned() or setEdgeAligned(), except that the emitter pin is
+     * not set.  Any other list clears the alignment, so the reading functions
+     * do nothing until the alignment is set again. */
+    void setSensorPins(const uint8_t * pins, uint8_t sensorCount);
+
+    /** \brief Sets the timeout for the sensors.  See
+     * QTRSensors::setTimeout(). */
+    void setTimeout(uint16_t timeout);
+
+    /** \brief Returns how long the most recent reading took.
+     *
+     * \return The time in microseconds from when the sensor lines were
+     *   released until every sensor being read had discharged, or until the
+     *   timeout if any sensor did not.
+     *
+     * A reading ends as soon as every sensor has discharged instead of always
+     * waiting for the timeout, so on a bright surface this can be much lower
+     * than getTimeout().  For QTRReadMode::OnAndOff and
+     * QTRReadMode::OddEvenAndOff, which take more than one reading, this is
+     * the duration of the last one. */
+    uint16_t getLastReadDuration() { return lastReadDuration; }
+
+    /** \brief Reads the raw sensor values.  See QTRSensors::read().
+     *
+     * If the alignment has not been set with setCenterAligned() or
+     * setEdgeAligned(), this does nothing. */
+    void read(uint16_t * sensorValues, QTRReadMode mode = QTRReadMode::On);
+
+    /** \brief Reads the sensors for calibration.  See
+     * QTRSensors::calibrate(). */
+    void calibrate(QTRReadMode mode = QTRReadMode::On);
+
+    /** \brief Resets all calibration that has been done. */
+    void resetCalibration();
+
+    /** \brief Tells this object that the calibration values have changed.
+     *
+     * readCalibrated() precomputes scale factors from
+     * QTRSensors::calibrationOn and QTRSensors::calibrationOff.  calibrate(),
+     * resetCalibration(), and loadCalibration() update them automatically,
+     * but if you change the calibration values yourself, you must call this
+     * function afterwards so that readCalibrated() uses the new values. */
+    void updateCalibrationScaling() { scalingMode = QTRReadMode::Manual; }
+
+    /** \brief Reads the sensors and provides calibrated values between 0 and
+     * 1000.  See QTRSensors::readCalibrated().
+     *
+     * To make this fast, the first call after the calibration changes (or
+     * after switching between modes that use different calibration values)
+     * computes a fixed-point scale factor for each sensor, and later calls
+     * only do a multiplication and a shift per sensor instead of a division.
+     * The values returned can differ from an exact calculation by at most 1.
+     * If you change QTRSensors::calibrationOn or QTRSensors::calibrationOff
+     * yourself, call updateCalibrationScaling() afterwards. */
+    void readCalibrated(uint16_t * sensorValues, QTRReadMode mode = QTRReadMode::On);
+
+    /** \brief Turns automatic calibration on or off.
+     *
+     * \param enabled True to keep adjusting the calibration while the
+     *   sensors are being read.
+     * \param decayShift How slowly the calibration forgets old extremes.
+     *   Each call moves the limit nearer to the reading inwards by
+     *   1/2^\p decayShift of the distance between the limits.  The default of 8 means that if
+     *   readCalibrated() is called 100 times per second, old extremes fade
+     *   with a time constant of about 2.5 seconds.
+     *
+     * With automatic calibration on, every call to readCalibrated() (and the
+     * line reading functions that use it) also updates the minimum and
+     * maximum calibration values of each sensor with the readings it just
+     * took, so the calibration follows slow changes in ambient light during a
+     * run without any extra readings.  A reading outside the limits moves the
+     * limit a quarter of the way toward it.  Otherwise, the limit nearer to
+     * the reading decays slowly toward it, but never past it and never closer
+     * than 1/16 of the timeout to the other limit.  The other limit stays
+     * put, so a sensor that has not seen the line for a while keeps its range
+     * and does not start amplifying noise.  One sensor's precomputed
+     * scale factor is updated per call, so this only adds a small amount of
+     * integer work per sensor.
+     *
+     * The sensors must already be calibrated, with calibrate() or
+     * loadCalibration().  Automatic calibration works with QTRReadMode::On,
+     * QTRReadMode::OddEven, and QTRReadMode::Off; it is not done for the
+     * modes that combine readings with the emitters on and off. */
+    void setAutoCalibration(bool enabled, uint8_t decayShift = 8);
+
+    /** \brief Makes QTRReadMode::OnAndOff reuse its readings with the
+     * emitters off.
+     *
+     * \param interval The number of calls to read() (or the functions that
+     *   use it) between readings with the emitters off.  0, the default,
+     *   takes them on every call, like QTRSensors does.
+     *
+     * With a nonzero interval, most calls with QTRReadMode::OnAndOff take a
+     * single reading with the emitters on and compensate it with the cached
+     * ambient readings, and the emitters are left on between calls instead of
+     * waiting for them to turn on and off every time, so a call takes roughly
+     * half as long.  This works well as long as the ambient light changes
+     * slowly compared to the interval.  To keep the refreshes fast too, the
+     * call before a refresh turns the emitters off without waiting for them,
+     * so the time it takes them to turn off (about 1.2 ms for dimmable
+     * emitters) overlaps with whatever your code does between calls.
+     *
+     * A change to the dimming level takes effect at the next refresh, since
+     * the emitters are not turned off and on again until then. */
+    void setAmbientRefreshInterval(uint8_t interval);
+
+    /** \brief Reads the sensors, provides calibrated values, and returns an
+     * estimated black line position.  See QTRSensors::readLineBlack(). */
+    uint16_t readLineBlack(uint16_t * sensorValues, QTRReadMode mode = QTRReadMode::On)
+    {
+        return readLinePrivate(sensorValues, mode, false);
+    }
+
+    /** \brief Reads the sensors, provides calibrated values, and returns an
+     * estimated white line position.  See QTRSensors::readLineWhite(). */
+    uint16_t readLineWhite(uint16_t * sensorValues, QTRReadMode mode = QTRReadMode::On)
+    {
+        return readLinePrivate(sensorValues, mode, true);
+    }
+
+    /** \brief Reads the sensors, provides calibrated values, and returns a
+     * detailed estimate of a black line.
+     *
+     * This works like readLineBlack(), but uses estimateLine() to find the
+     * line position and stores the details in \p estimate. */
+    uint16_t readLineBlack(uint16_t * sensorValues, LineEstimate & estimate,
+        QTRReadMode mode = QTRReadMode::On)
+    {
+        return readLineEstimatePrivate(sensorValues, estimate, mode, false);
+    }
+
+    /** \brief Reads the sensors, provides calibrated values, and returns a
+     * detailed estimate of a white line.
+     *
+     * This works like readLineWhite(), but uses estimateLine() to find the
+     * line position and stores the details in \p estimate. */
+    uint16_t readLineWhite(uint16_t * sensorValues, LineEstimate & estimate,
+        QTRReadMode mode = QTRReadMode::On)
+    {
+        return readLineEstimatePrivate(sensorValues, estimate, mode, true);
+    }
+
+    /** \brief Estimates the line position from calibrated readings, with
+     * sub-sensor resolution.
+     *
+     * \param sensorValues Calibrated readings (0 to 1000), such as those from
+     *   readCalibrated().
+     * \param[out] estimate The estimate of the line.
+     * \param whiteLine True to look for a white line on a dark background,
+     *   false to look for a black line.
+     *
+     * \return The estimated line position (the same as
+     *   LineEstimate::position).
+     *
+     * Sensors that read above 200 are considered to be over the line, and
+     * each group of adjacent ones is a segment.  If there is more than one
+     * segment, the one whose peak is closest to the last position is used.
+     * The position is found by fitting a parabola through the highest reading
+     * in that segment (or the middle of a run of adjacent equal highest
+     * readings) and its two neighbors and taking the location of its peak,
+     * which follows the line more smoothly between sensors than a weighted
+     * average, especially when only one or two sensors see the line.  If no
+     * line is seen, the position is 0 or 4000, depending on which side the
+     * line was last seen, like readLineBlack().
+     *
+     * This function only uses integer math and does a single division, so it
+     * takes well under 100 us. */
+    uint16_t estimateLine(const uint16_t * sensorValues, LineEstimate & estimate,
+        bool whiteLine = false);
+
+    /** \brief Starts reading the sensors in the background.
+     *
+     * \return True if the read was started, or false if a read is already in
+     * progress or the alignment has not been set with setCenterAligned() or
+     * setEdgeAligned().
+     *
+     * This function charges the sensor lines for 10 us, releases them, and
+     * returns.  A Timer 3 compare interrupt then samples all five sensors
+     * every 32 us and records the time at which each one goes low.  The read
+     * finishes as soon as every sensor has gone low, or when the timeout (see
+     * setTimeout()) is reached, whichever comes first.  The interrupt uses
+     * roughly a fifth of the CPU time while the read is in progress, and none
+     * after it finishes.
+     *
+     * The readings have the same units as the readings from read(), but they
+     * are only accurate to 32 us.  After getValues() returns the readings,
+     * getLastReadDuration() returns how long the read took.
+     *
+     * This function does not change the emitters.  Turn them on with
+     * QTRSensors::emittersOn() before starting the read; you can leave them
+     * on between reads.  Do not call any of the other reading or calibration
+     * functions while a read is in progress.
+     *
+     * Timer 3 is run in normal mode with a prescaler of 64, which is the same
+     * configuration used by Balboa32U4Encoders::enableEdgeTiming(), so the two
+     * can be used together.  This class defines an ISR for TIMER3_COMPA_vect,
+     * so there will be a link-time conflict with any other code that defines
+     * that ISR, including the Arduino tone() function.  The ISR is in its own
+     * object file, so it is only linked into sketches that use startRead(),
+     * isReadComplete(), or getValues(). */
+    bool startRead();
+
+    /** \brief Returns true if a read started with startRead() has finished
+     * and its values are available from getValues(). */
+    bool isReadComplete();
+
+    /** \brief Gets the readings from the last read started with startRead().
+     *
+     * \param[out] sensorValues A pointer to an array of five numbers where the
+     *   readings are stored.
+     *
+     * \return True if the readings were stored, or false if no read has
+     *   finished since the last call to startRead(). */
+    bool getValues(uint16_t * sensorValues);
+
+    /** \brief The number of bytes of EEPROM used by saveCalibration(). */
+    static const uint8_t calibrationRecordSize = 50;
+
+    /** \brief Saves the calibration to EEPROM.
+     *
+     * \param address The EEPROM address at which to store the record.  The
+     *   record takes #calibrationRecordSize bytes.
+     *
+     * \return True if the calibration was saved, or false if the alignment
+     *   has not been set with setCenterAligned() or setEdgeAligned() or if
+     *   the sensors have not been calibrated.
+     *
+     * The record holds the minimum and maximum values from
+     * QTRSensors::calibrationOn and QTRSensors::calibrationOff, which of them
+     * have been initialized, the sensor count, type, alignment, and timeout,
+     * a format version number, and a CRC that loadCalibration() uses to
+     * detect a missing or damaged record.  Only bytes that have changed are
+     * written, so saving the same calibration again does not wear out the
+     * EEPROM. */
+    bool saveCalibration(uint16_t address = 0);
+
+    /** \brief Restores the calibration from EEPROM.
+     *
+     * \param address The EEPROM address of the record written by
+     *   saveCalibration().
+     *
+     * \return True if the calibration was restored, or false if there is no
+     *   valid record at that address, if it was saved with a different
+     *   alignment or sensor type, or if it does not hold any calibration.
+     *
+     * If this returns true, the timeout is set to the value that was in use
+     * when the calibration was saved, and you can call readCalibrated() and
+     * the line reading functions right away without calling calibrate().  If
+     * it returns false, the current calibration is not changed.
+     *
+     * You must call setCenterAligned() or setEdgeAligned() before calling
+     * this function. */
+    bool loadCalibration(uint16_t address = 0);
+
+private:
+
+    enum class Alignment : uint8_t { None, Center, Edge };
+
+    void setAlignment(Alignment alignment);
+
+    // The bit for each sensor in a combined sample of the sensor ports, for
+    // each alignment.
+    static const uint8_t centerAlignedBits[sensorCount];
+    static const uint8_t edgeAlignedBits[sensorCount];
+
+    // Reads every step-th sensor starting with start, like the private
+    // readPrivate() in QTRSensors.
+    void readPrivate(uint16_t * sensorValues, uint8_t start = 0, uint8_t step = 1);
+
+    template <bool edgeAligned>
+    void readRCFast(uint16_t * sensorValues, uint8_t start, uint8_t step);
+
+    // Handles QTRReadMode::OnAndOff for read() when the ambient readings are
+    // cached; see setAmbientRefreshInterval().
+    void readOnAndCachedOff(uint16_t * sensorValues);
+
+    // Combines readings with the emitters on and off into (on + max - off).
+    void combineOnAndOff(uint16_t * sensorValues, const uint16_t * offValues);
+
+    bool emittersAreOn();
+
+    void calibrateOnOrOff(CalibrationData & calibration, QTRReadMode mode);
+
+    // Computes the calibration scaling used by readCalibrated() for mode,
+    // which must be QTRReadMode::On, QTRReadMode::Off, or
+    // QTRReadMode::OnAndOff.
+    void updateScaling(QTRReadMode mode);
+    void updateSensorScaling(QTRReadMode mode, uint8_t i);
+
+    // Updates the calibration with new readings; see setAutoCalibration().
+    void trackCalibration(const uint16_t * sensorValues, QTRReadMode mode);
+
+    uint16_t readLinePrivate(uint16_t * sensorValues, QTRReadMode mode, bool invertReadings);
+    uint16_t readLineEstimatePrivate(uint16_t * sensorValues, LineEstimate & estimate,
+        QTRReadMode mode, bool invertReadings);
+
+    Alignment alignment = Alignment::None;
+
+    uint16_t lastReadDuration = 0;
+    uint16_t lastPosition = 0;
+
+    // QTRSensors::calibrationOn and QTRSensors::calibrationOff point to these
+    // instead of to memory from the heap.
+    uint16_t calibrationOnMinimum[sensorCount];
+    uint16_t calibrationOnMaximum[sensorCount];
+    uint16_t calibrationOffMinimum[sensorCount];
+    uint16_t calibrationOffMaximum[sensorCount];
+
+    // The calibration scaling used by readCalibrated().  For each sensor, the
+    // calibrated value is ((reading - offset) * scale) >> 16, or 1000 if
+    // (reading - offset) is at least range.  scalingMode is the mode the
+    // scaling was computed for, or QTRReadMode::Manual if it needs to be
+    // recomputed.
+    uint16_t scaleOffset[sensorCount];
+    uint16_t scaleRange[sensorCount];
+    uint32_t scale[sensorCount];
+    QTRReadMode scalingMode = QTRReadMode::Manual;
+
+    uint8_t autoCalibrationShift = 0;  // 0 if automatic calibration is off
+    uint8_t autoCalibrationNext = 0;  // the next sensor to rescale
+
+    // The cached readings with the emitters off; see
+    // setAmbientRefreshInterval().  They are taken again when ambientCallsLeft
+    // reaches 0.  If ambientSettling is true, the emitters were turned off at
+    // ambientOffStart without waiting for them.
+    uint16_t ambientValues[sensorCount];
+    uint8_t ambientRefreshInterval = 0;
+    uint8_t ambientCallsLeft = 0;
+    bool ambientSettling = false;
+    uint16_t ambientOffStart = 0;
+};
@@ -0,0 +1,151 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+// Background reads are in their own file so that the TIMER3_COMPA_vect ISR,
+// which conflicts with tone(), is only linked into sketches that use them.
+// This relies on dot_a_linkage, which only applies to the src directory.
+
+#include <Arduino.h>
+#include <Balboa32U4LineSensors.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+// Asynchronous reads run Timer 3 with a prescaler of 64, so its counter
+// increments every 4 us.
+#define TIMER3_US_PER_TICK 4
+
+// The number of Timer 3 ticks between samples during an asynchronous read
+// (32 us).
+#define ASYNC_SAMPLE_TICKS 8
+
+// The state of an asynchronous read.  All of these except asyncReadState are
+// only used by the ISR while a read is in progress.
+enum class AsyncReadState : uint8_t { Idle, Busy, Done };
+static volatile AsyncReadState asyncReadState = AsyncReadState::Idle;
+static const uint8_t * asyncBits;
+static uint8_t asyncMaskF;
+static uint8_t asyncMaskC;
+static uint8_t asyncMaskD;
+static uint8_t asyncPending;
+static uint16_t asyncStart;
+static uint16_t asyncTimeoutTicks;
+static uint16_t asyncValues[5];
+static uint16_t asyncDuration;
+
+ISR(TIMER3_COMPA_vect)
+{
+    uint16_t ticks = TCNT3 - asyncStart;
+    uint16_t time = ticks * TIMER3_US_PER_TICK;
+    uint8_t state = (PINF & asyncMaskF) | (PINC & asyncMaskC) | (PIND & asyncMaskD);
+
+    if (ticks < asyncTimeoutTicks)
+    {
+        uint8_t low = asyncPending & ~state;
+        if (low)
+        {
+            // Record the first time each of these lines read low.
+            asyncPending &= ~low;
+            for (uint8_t i = 0; i < 5; i++)
+            {
+                if (low & asyncBits[i]) { asyncValues[i] = time; }
+            }
+        }
+
+        if (asyncPending)
+        {
+            // If this ISR started late (for example, because another ISR
+            // was running), the next compare time might already have passed,
+            // and the read would then stall until Timer 3 wrapped around
+            // 262 ms later.  In that case, sample again a full period from
+            // now instead.  The margin of 2 ticks (128 cycles) leaves time to
+            // write OCR3A before the counter reaches it.
+            uint16_t next = OCR3A + ASYNC_SAMPLE_TICKS;
+            uint16_t now = TCNT3;
+            if ((int16_t)(next - now) < 2)
+            {
+                next = now + ASYNC_SAMPLE_TICKS;
+            }
+            OCR3A = next;
+            return;
+        }
+    }
+
+    TIMSK3 &= ~(1 << OCIE3A);
+    asyncDuration = time;
+    asyncReadState = AsyncReadState::Done;
+}
+
+bool Balboa32U4LineSensors::startRead()
+{
+    if (alignment == Alignment::None) { return false; }
+    if (asyncReadState == AsyncReadState::Busy) { return false; }
+
+    bool edgeAligned = alignment == Alignment::Edge;
+    asyncBits = edgeAligned ? edgeAlignedBits : centerAlignedBits;
+    asyncMaskF = (1 << 1) | (1 << 4) | (1 << 5) | (1 << 7);
+    asyncMaskC = edgeAligned ? 0 : (1 << 6);
+    asyncMaskD = edgeAligned ? (1 << 6) : 0;
+    asyncPending = asyncMaskF | asyncMaskC | asyncMaskD;
+
+    const uint16_t timeout = getTimeout();
+    asyncTimeoutTicks = (timeout + TIMER3_US_PER_TICK - 1) / TIMER3_US_PER_TICK;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        asyncValues[i] = timeout;
+    }
+
+    // Timer 3 configuration
+    // prescaler: clockI/O / 64
+    // normal mode, no outputs
+    // Writing the same configuration again does not disturb the counter, so
+    // this is safe if Balboa32U4Encoders is already using the timer.
+    TCCR3A = 0;
+    TCCR3B = (1 << CS31) | (1 << CS30);
+
+    // Drive the sensor lines high to charge the sensors.
+    uint8_t sreg = SREG;
+    cli();
+    PORTF |= asyncMaskF;
+    DDRF |= asyncMaskF;
+    PORTC |= asyncMaskC;
+    DDRC |= asyncMaskC;
+    PORTD |= asyncMaskD;
+    DDRD |= asyncMaskD;
+    SREG = sreg;
+
+    delayMicroseconds(10);
+
+    // Switch all the lines to inputs (without pull-ups), record the start
+    // time, and schedule the first sample.
+    cli();
+    asyncStart = TCNT3;
+    DDRF &= ~asyncMaskF;
+    PORTF &= ~asyncMaskF;
+    DDRC &= ~asyncMaskC;
+    PORTC &= ~asyncMaskC;
+    DDRD &= ~asyncMaskD;
+    PORTD &= ~asyncMaskD;
+    OCR3A = asyncStart + ASYNC_SAMPLE_TICKS;
+    TIFR3 = (1 << OCF3A);
+    TIMSK3 |= (1 << OCIE3A);
+    asyncReadState = AsyncReadState::Busy;
+    SREG = sreg;
+
+    return true;
+}
+
+bool Balboa32U4LineSensors::isReadComplete()
+{
+    return asyncReadState == AsyncReadState::Done;
+}
+
+bool Balboa32U4LineSensors::getValues(uint16_t * sensorValues)
+{
+    if (asyncReadState != AsyncReadState::Done) { return false; }
+
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        sensorValues[i] = asyncValues[i];
+    }
+    lastReadDuration = asyncDuration;
+    return true;
+}
@@ -0,0 +1,229 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4Motors.h>
+#include <FastGPIO.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define PWM_L 10
+#define PWM_R 9
+#define DIR_L 16
+#define DIR_R 15
+
+bool Balboa32U4Motors::flipLeft = false;
+bool Balboa32U4Motors::flipRight = false;
+
+int16_t Balboa32U4Motors::maxSpeed = 300;
+
+uint16_t Balboa32U4Motors::nominalMillivolts = 0;
+uint16_t Balboa32U4Motors::batteryMultiplier = 1024;
+void (*Balboa32U4Motors::batteryRefresh)() = 0;
+
+// Stops any ramp in progress so that the caller can set the speeds directly.
+// The ramp code is in Balboa32U4MotorsRamp.cpp, but this only needs to
+// disable its interrupt, so it does not link that file.
+static inline void stopRamp()
+{
+    TIMSK1 &= ~(1 << TOIE1);
+}
+
+// initialize timer1 to generate the proper PWM outputs to the motor drivers
+void Balboa32U4Motors::init2(uint16_t top)
+{
+    FastGPIO::Pin<PWM_L>::setOutputLow();
+    FastGPIO::Pin<PWM_R>::setOutputLow();
+    FastGPIO::Pin<DIR_L>::setOutputLow();
+    FastGPIO::Pin<DIR_R>::setOutputLow();
+
+    // Timer 1 configuration
+    // prescaler: clockI/O / 1
+    // outputs enabled
+    // phase-correct PWM (mode 10), so OCR1A/OCR1B are updated at TOP
+    // top of 400 by default (see Balboa32U4MotorsPwm)
+    //
+    // PWM frequency calculation
+    // 16MHz / 1 (prescaler) / 2 (phase-correct) / 400 (top) = 20kHz
+    TCCR1A = 0b10100010;
+    TCCR1B = 0b00010001;
+    ICR1 = top;
+    OCR1A = 0;
+    OCR1B = 0;
+}
+
+void Balboa32U4Motors::flipLeftMotor(bool flip)
+{
+    flipLeft = flip;
+}
+
+void Balboa32U4Motors::flipRightMotor(bool flip)
+{
+    flipRight = flip;
+}
+
+template <uint16_t top>
+void Balboa32U4Motors::setLeftSpeedPwm(int16_t speed)
+{
+    init<top>();
+    if (batteryRefresh) { batteryRefresh(); }
+    stopRamp();
+
+    bool reverse = 0;
+
+    if (speed < 0)
+    {
+        speed = -speed; // Make speed a positive quantity.
+        reverse = 1;    // Preserve the direction.
+    }
+    speed = scaleSpeed<top>(speed);
+
+    OCR1B = speed;
+
+    FastGPIO::Pin<DIR_L>::setOutput(reverse ^ flipLeft);
+}
+
+template <uint16_t top>
+void Balboa32U4Motors::setRightSpeedPwm(int16_t speed)
+{
+    init<top>();
+    if (batteryRefresh) { batteryRefresh(); }
+    stopRamp();
+
+    bool reverse = 0;
+
+    if (speed < 0)
+    {
+        speed = -speed;  // Make speed a positive quantity.
+        reverse = 1;     // Preserve the direction.
+    }
+    speed = scaleSpeed<top>(speed);
+
+    OCR1A = speed;
+
+    FastGPIO::Pin<DIR_R>::setOutput(reverse ^ flipRight);
+}
+
+template <uint16_t top>
+void Balboa32U4Motors::setSpeedsPwm(int16_t leftSpeed, int16_t rightSpeed)
+{
+    init<top>();
+    if (batteryRefresh) { batteryRefresh(); }
+    stopRamp();
+
+    bool leftReverse = 0;
+    if (leftSpeed < 0)
+    {
+        leftSpeed = -leftSpeed;
+        leftReverse = 1;
+    }
+    leftSpeed = scaleSpeed<top>(leftSpeed);
+    leftReverse ^= flipLeft;
+
+    bool rightReverse = 0;
+    if (rightSpeed < 0)
+    {
+        rightSpeed = -rightSpeed;
+        rightReverse = 1;
+    }
+    rightSpeed = scaleSpeed<top>(rightSpeed);
+    rightReverse ^= flipRight;
+
+    // OCR1A and OCR1B are double-buffered and take effect together at the next
+    // TOP.  Make sure we are not about to reach TOP so that both new values take
+    // effect in the same PWM period.  The check is done with interrupts
+    // disabled so that an interrupt cannot delay the writes past TOP after it.
+    uint8_t oldSREG = SREG;
+    while (true)
+    {
+        cli();
+        if (TCNT1 <= top - 32) { break; }
+        SREG = oldSREG;
+    }
+    TIFR1 = (1 << ICF1);  // Clear the TOP flag by writing a 1.
+    OCR1B = leftSpeed;
+    OCR1A = rightSpeed;
+    SREG = oldSREG;
+
+    if (leftReverse == FastGPIO::Pin<DIR_L>::isOutputValueHigh() &&
+        rightReverse == FastGPIO::Pin<DIR_R>::isOutputValueHigh())
+    {
+        return;
+    }
+
+    // A direction is changing.  Change it just after TOP, when the new duty
+    // cycles have taken effect and the outputs are low, so that the old duty
+    // cycle is never applied in the new direction.  This waits for at most one
+    // PWM period (50 us by default) each time.
+    uint16_t lowUntil = leftSpeed > rightSpeed ? leftSpeed : rightSpeed;
+    if (lowUntil > top - 16)
+    {
+        // At or near full duty cycle there is no low period to wait for.
+        lowUntil = top - 16;
+    }
+    while (true)
+    {
+        while (!(TIFR1 & (1 << ICF1))) { }
+
+        cli();
+        if (TCNT1 > lowUntil)
+        {
+            FastGPIO::Pin<DIR_L>::setOutput(leftReverse);
+            FastGPIO::Pin<DIR_R>::setOutput(rightReverse);
+            SREG = oldSREG;
+            return;
+        }
+
+        // An interrupt delayed us too much; try again at the next TOP.
+        TIFR1 = (1 << ICF1);
+        SREG = oldSREG;
+    }
+}
+
+// These are the PWM profiles supported by Balboa32U4MotorsPwm.
+#define BALBOA_32U4_MOTORS_PWM_PROFILE(top) \
+    template void Balboa32U4Motors::setLeftSpeedPwm<top>(int16_t); \
+    template void Balboa32U4Motors::setRightSpeedPwm<top>(int16_t); \
+    template void Balboa32U4Motors::setSpeedsPwm<top>(int16_t, int16_t);
+BALBOA_32U4_MOTORS_PWM_PROFILE(400)
+BALBOA_32U4_MOTORS_PWM_PROFILE(800)
+BALBOA_32U4_MOTORS_PWM_PROFILE(1600)
+
+void Balboa32U4Motors::setLeftSpeed(int16_t speed)
+{
+    setLeftSpeedPwm<400>(speed);
+}
+
+void Balboa32U4Motors::setRightSpeed(int16_t speed)
+{
+    setRightSpeedPwm<400>(speed);
+}
+
+void Balboa32U4Motors::setSpeeds(int16_t leftSpeed, int16_t rightSpeed)
+{
+    setSpeedsPwm<400>(leftSpeed, rightSpeed);
+}
+
+void Balboa32U4Motors::allowTurbo(bool turbo)
+{
+    maxSpeed = turbo ? 400 : 300;
+}
+
+void Balboa32U4Motors::setBatteryMillivolts(uint16_t millivolts)
+{
+    if (nominalMillivolts == 0) { return; }
+
+    // Limit the ratio to between 0.5 and 2.
+    uint16_t multiplier;
+    if (millivolts <= nominalMillivolts / 2)
+    {
+        multiplier = 2048;
+    }
+    else if (millivolts >= nominalMillivolts * 2UL)
+    {
+        multiplier = 512;
+    }
+    else
+    {
+        multiplier = ((uint32_t)nominalMillivolts << 10) / millivolts;
+    }
+    batteryMultiplier = multiplier;
+}
@@ -0,0 +1,396 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4Motors.h */
+
+#pragma once
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <FastGPIO.h>
+
+template <bool flipLeft, bool flipRight, int16_t maxSpeed, uint16_t pwmTop>
+class Balboa32U4MotorsT;
+
+/*! \brief Controls motor speed and direction on the Balboa 32U4.
+ *
+ * This library uses Timer 1, so it will conflict with any other libraries using
+ * that timer.  It also defines an ISR for TIMER1_OVF_vect, which is used to
+ * limit acceleration (see setAcceleration()).  The ISR is in its own object
+ * file, so it is only linked into sketches that call setTargetSpeeds() or
+ * setAcceleration(). */
+class Balboa32U4Motors
+{
+  public:
+
+    /** \brief Flips the direction of the left motor.
+     *
+     * You can call this function with an argument of \c true if the left motor
+     * of your Balboa was not wired in the standard way and you want a
+     * positive speed argument to correspond to forward movement.
+     *
+     * \param flip If true, then positive motor speeds will correspond to the
+     * direction pin being high.  If false, then positive motor speeds will
+     * correspond to the direction pin being low.
+     */
+    static void flipLeftMotor(bool flip);
+
+    /** \brief Flips the direction of the right motor.
+     *
+     * You can call this function with an argument of \c true if the right motor
+     * of your Balboa was not wired in the standard way and you want a
+     * positive speed argument to correspond to forward movement.
+     *
+     * \param flip If true, then positive motor speeds will correspond to the
+     * direction pin being high.  If false, then positive motor speeds will
+     * correspond to the direction pin being low. */
+    static void flipRightMotor(bool flip);
+
+    /** \brief Sets the speed for the left motor.
+     *
+     * \param speed A number from -300 to 300 representing the speed and
+     * direction of the left motor.  Values of -300 or less result in full speed
+     * reverse, and values of 300 or more result in full speed forward. */
+    static void setLeftSpeed(int16_t speed);
+
+    /** \brief Sets the speed for the right motor.
+     *
+     * \param speed A number from -300 to 300 representing the speed and
+     * direction of the right motor. Values of -300 or less result in full speed
+     * reverse, and values of 300 or more result in full speed forward. */
+    static void setRightSpeed(int16_t speed);
+
+    /** \brief Sets the speed for both motors.
+     *
+     * \param leftSpeed A number from -300 to 300 representing the speed and
+     * direction of the right motor. Values of -300 or less result in full speed
+     * reverse, and values of 300 or more result in full speed forward.
+     * \param rightSpeed A number from -300 to 300 representing the speed and
+     * direction of the right motor. Values of -300 or less result in full speed
+     * reverse, and values of 300 or more result in full speed forward.
+     *
+     * The new duty cycles of both motors always take effect in the same PWM
+     * period.  If the direction of either motor changes, this function waits
+     * for the start of the next PWM period (at most 50 us) to change the
+     * direction pins, so that a motor never briefly runs in the new direction
+     * with its old duty cycle. */
+    static void setSpeeds(int16_t leftSpeed, int16_t rightSpeed);
+
+    /** \brief Sets the maximum rate at which setTargetSpeeds() changes the
+     * motor speeds.
+     *
+     * \param maxChangePerMs The largest change in speed allowed per
+     * millisecond, in the same units as the other functions in this class.
+     * For example, 2 means it takes 150 ms to go from 0 to 300.  A value of 0
+     * (the default) means there is no limit.
+     *
+     * This function does not have any immediate effect on the speed of the
+     * motors; it just changes the behavior of setTargetSpeeds().  The one
+     * exception is removing the limit during a ramp: the motors then go to
+     * their targets within a millisecond and the ramp stops. */
+    static void setAcceleration(uint16_t maxChangePerMs);
+
+    /** \brief Ramps the speeds of both motors toward new targets in the
+     * background.
+     *
+     * \param leftSpeed The target speed for the left motor, from -300 to 300
+     * (or -400 to 400 in turbo mode).
+     * \param rightSpeed The target speed for the right motor.
+     *
+     * This function returns immediately.  The Timer 1 overflow interrupt then
+     * changes each motor's speed by up to the amount set with
+     * setAcceleration() every millisecond until it reaches the target.  When
+     * a motor changes direction, its speed stays at 0 for one step before the
+     * direction changes.  The interrupt only runs while a ramp is in progress,
+     * and on most PWM periods it just decrements a counter.
+     *
+     * If no acceleration limit is set, this is the same as setSpeeds().
+     * Calling setSpeeds(), setLeftSpeed(), or setRightSpeed() stops any ramp
+     * in progress. */
+    static void setTargetSpeeds(int16_t leftSpeed, int16_t rightSpeed);
+
+    /** \brief Turns turbo mode on or off.
+     *
+     * By default turbo mode is off.  When turbo mode is on, the range of speeds
+     * accepted by the other functions in this library becomes -400 to 400
+     * (instead of -300 to 300).  Turning turbo mode on allows the Balboa to move
+     * faster but could decrease the lifetime of the motors.
+     *
+     * This function does not have any immediate effect on the speed of the
+     * motors; it just changes the behavior of the other functions in this
+     * library.
+     *
+     * \param turbo If true, turns turbo mode on.
+     *   If false, turns turbo mode off. */
+    static void allowTurbo(bool turbo);
+
+    /** \brief Returns the largest speed accepted by the other functions in
+     * this class: 300, or 400 if turbo mode is on (see allowTurbo()). */
+    static int16_t getMaxSpeed() { return maxSpeed; }
+
+    /** \brief Turns battery voltage compensation on or off.
+     *
+     * As the batteries discharge, the same speed setting produces less motor
+     * voltage and therefore less speed and torque.  When compensation is on,
+     * every speed given to this class is multiplied by the ratio of
+     * \p nominalMillivolts to the most recent battery voltage passed to
+     * setBatteryMillivolts(), so the motors get about the same average voltage
+     * regardless of the state of the batteries.  The result is still limited
+     * to the range described in allowTurbo(), and the ratio is limited to
+     * between 0.5 and 2.
+     *
+     * While compensation is on and Balboa32U4ADC is sampling in the
+     * background (see Balboa32U4ADC::start()), the functions that set speeds
+     * keep the battery voltage up to date by themselves: every 16th call
+     * passes Balboa32U4ADC::getBatteryMillivoltsIfRunning() to
+     * setBatteryMillivolts() if it has changed.
+     * Otherwise, call setBatteryMillivolts() yourself every second or so.
+     *
+     * \param nominalMillivolts The battery voltage at which speeds are not
+     *   changed, for example 7200 for six NiMH cells.  0 turns compensation
+     *   off, which is the default. */
+    static void setBatteryCompensation(uint16_t nominalMillivolts);
+
+    /** \brief Updates the battery voltage used for compensation.
+     *
+     * \param millivolts The battery voltage, as returned by
+     *   readBatteryMillivolts().
+     *
+     * This does the division needed to compute the compensation ratio, so the
+     * functions that set speeds only need one multiplication.  You do not
+     * need to call this if Balboa32U4ADC is running (see
+     * setBatteryCompensation()). */
+    static void setBatteryMillivolts(uint16_t millivolts);
+
+  protected:
+
+    // These implement the speed-setting functions for a given Timer 1 TOP
+    // value.  Speeds are in units where top is full speed.  They are
+    // explicitly instantiated for the supported profiles in
+    // Balboa32U4Motors.cpp, except for setTargetSpeedsPwm(), which is in
+    // Balboa32U4MotorsRamp.cpp with the ISR it uses.
+    template <uint16_t top> static void setLeftSpeedPwm(int16_t speed);
+    template <uint16_t top> static void setRightSpeedPwm(int16_t speed);
+    template <uint16_t top> static void setSpeedsPwm(int16_t leftSpeed, int16_t rightSpeed);
+    template <uint16_t top> static void setTargetSpeedsPwm(int16_t leftSpeed, int16_t rightSpeed);
+
+  private:
+
+    template <bool, bool, int16_t, uint16_t> friend class Balboa32U4MotorsT;
+
+    template <uint16_t top>
+    static inline void init()
+    {
+        static bool initialized = false;
+
+        if (!initialized)
+        {
+            initialized = true;
+            init2(top);
+        }
+    }
+
+    static void init2(uint16_t top);
+
+    // Called by the speed-setting functions while battery compensation is on.
+    // This is a pointer so that the speed-setting functions do not link
+    // Balboa32U4MotorsBattery.cpp into sketches that never turn compensation
+    // on.
+    static void (*batteryRefresh)();
+
+    static void refreshBatteryFromADC();
+
+    // Applies battery compensation to a speed magnitude and limits it to
+    // maxSpeed, which is in units where 400 is full speed, scaled to units
+    // where top is full speed.  The scaling is a constant power of 2, so it
+    // compiles to shifts.
+    template <uint16_t top>
+    static inline uint16_t scaleSpeed(uint16_t speed)
+    {
+        if (batteryMultiplier != 1024)
+        {
+            uint32_t scaled = ((uint32_t)speed * batteryMultiplier) >> 10;
+            speed = scaled > 0xFFFF ? 0xFFFF : scaled;
+        }
+        uint16_t limit = (uint16_t)maxSpeed * (top / 400);
+        if (speed > limit)
+        {
+            speed = limit;
+        }
+        return speed;
+    }
+
+    static uint16_t nominalMillivolts;
+    static uint16_t batteryMultiplier;  // 1024 represents 1
+    static int16_t maxSpeed;
+    static bool flipLeft;
+    static bool flipRight;
+};
+
+/*! \brief Controls the motors with a different PWM frequency and resolution.
+ *
+ * Balboa32U4Motors runs the motor PWM at 20 kHz with 400 steps of duty cycle
+ * resolution in each direction.  This class lets you trade frequency for
+ * resolution, which can reduce limit cycling in control loops such as the
+ * balancer when the motors are running slowly.
+ *
+ * \tparam pwmTop The Timer 1 TOP value, which is also the number of speed
+ * steps.  It must be one of:
+ * - 400: 20 kHz (the same as Balboa32U4Motors)
+ * - 800: 10 kHz
+ * - 1600: 5 kHz
+ *
+ * The speed arguments of setSpeeds(), setLeftSpeed(), setRightSpeed(), and
+ * setTargetSpeeds() are in units where \p pwmTop is full speed, so, for
+ * example, with Balboa32U4MotorsPwm<800> the speed range is -600 to 600, or
+ * -800 to 800 in turbo mode.  The acceleration passed to setAcceleration() is
+ * in the same units.  The conversion is chosen at compile time, so these
+ * functions are just as fast as the ones in Balboa32U4Motors.
+ *
+ * The PWM frequencies lower than 20 kHz are audible, so the motors will whine
+ * more.  Do not use this class together with Balboa32U4Motors or with a
+ * different \p pwmTop in the same program, since they all configure Timer 1.
+ *
+ * Example:
+ *
+ * ~~~{.cpp}
+ * Balboa32U4MotorsPwm<1600> motors;
+ *
+ * void setup()
+ * {
+ *   motors.setSpeeds(150, -150);  // about 1/8 of full speed
+ * }
+ * ~~~
+ */
+template <uint16_t pwmTop>
+class Balboa32U4MotorsPwm : public Balboa32U4Motors
+{
+    static_assert(pwmTop == 400 || pwmTop == 800 || pwmTop == 1600,
+        "pwmTop must be 400, 800, or 1600.");
+
+  public:
+
+    /** \brief Sets the speed for the left motor.  See
+     * Balboa32U4Motors::setLeftSpeed(). */
+    static void setLeftSpeed(int16_t speed)
+    {
+        setLeftSpeedPwm<pwmTop>(speed);
+    }
+
+    /** \brief Sets the speed for the right motor.  See
+     * Balboa32U4Motors::setRightSpeed(). */
+    static void setRightSpeed(int16_t speed)
+    {
+        setRightSpeedPwm<pwmTop>(speed);
+    }
+
+    /** \brief Sets the speed for both motors.  See
+     * Balboa32U4Motors::setSpeeds(). */
+    static void setSpeeds(int16_t leftSpeed, int16_t rightSpeed)
+    {
+        setSpeedsPwm<pwmTop>(leftSpeed, rightSpeed);
+    }
+
+    /** \brief Ramps the speeds of both motors toward new targets in the
+     * background.  See Balboa32U4Motors::setTargetSpeeds(). */
+    static void setTargetSpeeds(int16_t leftSpeed, int16_t rightSpeed)
+    {
+        setTargetSpeedsPwm<pwmTop>(leftSpeed, rightSpeed);
+    }
+};
+
+/*! \brief Controls the motors with settings that are fixed at compile time.
+ *
+ * Balboa32U4Motors checks whether it has been initialized, and looks up the
+ * flip and turbo settings, every time you set a speed.  If your program never
+ * changes those settings, you can use this class instead, and the compiler
+ * will turn each speed-setting function into just a few instructions: a
+ * comparison and limit, a write to the Timer 1 compare register, and a write
+ * to the direction pin.
+ *
+ * \tparam flipLeft If true, the direction of the left motor is flipped (see
+ *   Balboa32U4Motors::flipLeftMotor()).
+ * \tparam flipRight If true, the direction of the right motor is flipped.
+ * \tparam maxSpeed The largest speed allowed.  With the default PWM profile,
+ *   this should be 300, or 400 to get the same behavior as turbo mode (see
+ *   Balboa32U4Motors::allowTurbo()).
+ * \tparam pwmTop The Timer 1 TOP value, which sets the PWM frequency and the
+ *   units of speed (see Balboa32U4MotorsPwm).
+ *
+ * You must call init() once, for example in setup(), before setting any
+ * speeds.  It cannot be done in a constructor because the Arduino core
+ * reconfigures Timer 1 after global constructors run.
+ *
+ * This class does not support the acceleration limit or battery
+ * compensation features of Balboa32U4Motors, and it does not wait to
+ * synchronize direction changes with the PWM period.  Do not use it together
+ * with Balboa32U4Motors or Balboa32U4MotorsPwm in the same program.
+ *
+ * Example:
+ *
+ * ~~~{.cpp}
+ * Balboa32U4MotorsT<false, false, 400> motors;
+ *
+ * void setup()
+ * {
+ *   motors.init();
+ *   motors.setSpeeds(100, 100);
+ * }
+ * ~~~
+ */
+template <bool flipLeft = false, bool flipRight = false, int16_t maxSpeed = 300,
+    uint16_t pwmTop = 400>
+class Balboa32U4MotorsT
+{
+    static_assert(pwmTop == 400 || pwmTop == 800 || pwmTop == 1600,
+        "pwmTop must be 400, 800, or 1600.");
+    static_assert(maxSpeed > 0 && maxSpeed <= (int16_t)pwmTop,
+        "maxSpeed must be between 1 and pwmTop.");
+
+  public:
+
+    /** \brief Configures Timer 1 and the motor pins.  Call this once before
+     * setting any speeds. */
+    static void init()
+    {
+        Balboa32U4Motors::init2(pwmTop);
+    }
+
+    /** \brief Sets the speed for the left motor.
+     *
+     * \param speed A number from -maxSpeed to maxSpeed.  Values outside of
+     * that range are limited to it. */
+    static inline void setLeftSpeed(int16_t speed) __attribute__((always_inline))
+    {
+        bool reverse = speed < 0;
+        if (reverse) { speed = -speed; }
+        if (speed > maxSpeed) { speed = maxSpeed; }
+        OCR1B = speed;
+        FastGPIO::Pin<dirLeft>::setOutput(reverse ^ flipLeft);
+    }
+
+    /** \brief Sets the speed for the right motor.  See setLeftSpeed(). */
+    static inline void setRightSpeed(int16_t speed) __attribute__((always_inline))
+    {
+        bool reverse = speed < 0;
+        if (reverse) { speed = -speed; }
+        if (speed > maxSpeed) { speed = maxSpeed; }
+        OCR1A = speed;
+        FastGPIO::Pin<dirRight>::setOutput(reverse ^ flipRight);
+    }
+
+    /** \brief Sets the speed for both motors.  See setLeftSpeed().
+     *
+     * The compare registers are double-buffered, so both new duty cycles take
+     * effect at the start of the same PWM period unless that period starts
+     * while this function is running. */
+    static inline void setSpeeds(int16_t leftSpeed, int16_t rightSpeed) __attribute__((always_inline))
+    {
+        setLeftSpeed(leftSpeed);
+        setRightSpeed(rightSpeed);
+    }
+
+  private:
+
+    static const uint8_t dirLeft = 16;
+    static const uint8_t dirRight = 15;
+};
@@ -0,0 +1,47 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+// Battery compensation is in its own file so that sketches that do not use it
+// do not link it.  It gets the battery voltage from
+// Balboa32U4ADC::getBatteryMillivoltsIfRunning(), which does not link the
+// ADC_vect ISR; only sketches that start Balboa32U4ADC themselves get it.
+
+#include <Balboa32U4Motors.h>
+#include <Balboa32U4ADC.h>
+
+// The number of speed changes between checks for a new battery voltage.
+#define BATTERY_CHECK_INTERVAL 16
+
+static uint8_t batteryCheckCountdown;
+static uint16_t lastBatteryMillivolts;
+
+void Balboa32U4Motors::setBatteryCompensation(uint16_t nominal)
+{
+    nominalMillivolts = nominal;
+    if (nominal == 0)
+    {
+        batteryRefresh = 0;
+        batteryMultiplier = 1024;
+        return;
+    }
+
+    // Check on the next speed change, so the compensation uses the current
+    // battery voltage right away if one has been sampled.
+    batteryCheckCountdown = 1;
+    lastBatteryMillivolts = 0;
+    batteryRefresh = refreshBatteryFromADC;
+}
+
+void Balboa32U4Motors::refreshBatteryFromADC()
+{
+    if (--batteryCheckCountdown) { return; }
+    batteryCheckCountdown = BATTERY_CHECK_INTERVAL;
+
+    // This is 0 unless Balboa32U4ADC is running and has sampled the battery.
+    // Skipping unchanged voltages avoids the division in
+    // setBatteryMillivolts().
+    uint16_t millivolts = Balboa32U4ADC::getBatteryMillivoltsIfRunning();
+    if (millivolts == 0 || millivolts == lastBatteryMillivolts) { return; }
+    lastBatteryMillivolts = millivolts;
+
+    setBatteryMillivolts(millivolts);
+}
@@ -0,0 +1,161 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+// Acceleration limiting for the Balboa 32U4 motors.  This is in its own file
+// so that the TIMER1_OVF_vect ISR is only linked into sketches that call
+// setTargetSpeeds() or setAcceleration().  This relies on dot_a_linkage,
+// which only applies to the src directory.
+
+#include <Balboa32U4Motors.h>
+#include <FastGPIO.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define DIR_L 16
+#define DIR_R 15
+
+// Slew-rate limiting state, shared with the Timer 1 overflow ISR.  The speeds
+// are signed and do not include the effect of flipLeft/flipRight; the flip
+// settings in effect when setTargetSpeeds() was last called are copied here so
+// the ISR does not need to access private members.
+static volatile uint16_t rampStep;
+static volatile uint8_t rampDivider;
+static uint8_t rampDividerReload;  // Timer 1 overflows per millisecond
+static volatile int16_t rampSpeedLeft;
+static volatile int16_t rampSpeedRight;
+static volatile int16_t rampTargetLeft;
+static volatile int16_t rampTargetRight;
+static volatile bool rampFlipLeft;
+static volatile bool rampFlipRight;
+
+// Moves speed toward target by at most step.  If the target is in the other
+// direction, this stops at 0 first so that the direction pin only changes
+// while the duty cycle is 0.
+static inline int16_t rampToward(int16_t speed, int16_t target, int16_t step)
+{
+    if ((speed > 0 && target < 0) || (speed < 0 && target > 0))
+    {
+        target = 0;
+    }
+
+    if (target > speed)
+    {
+        return (target - speed > step) ? speed + step : target;
+    }
+    else
+    {
+        return (speed - target > step) ? speed - step : target;
+    }
+}
+
+// Timer 1 overflows at BOTTOM, once per PWM period (20000 times per second
+// by default).  Most of the time this ISR just counts down; once per
+// millisecond it moves each motor a step closer to its target, and it disables
+// itself once both targets are reached.
+ISR(TIMER1_OVF_vect)
+{
+    if (--rampDivider) { return; }
+
+    int16_t step = rampStep;
+    if (step == 0)
+    {
+        // The limit was removed during a ramp, so finish it at the next
+        // overflow, or the one after that if a direction has to change.
+        step = 0x7FFF;
+        rampDivider = 1;
+    }
+    else
+    {
+        rampDivider = rampDividerReload;
+    }
+
+    int16_t left = rampToward(rampSpeedLeft, rampTargetLeft, step);
+    int16_t right = rampToward(rampSpeedRight, rampTargetRight, step);
+    rampSpeedLeft = left;
+    rampSpeedRight = right;
+
+    // The new compare values take effect at the next TOP.  The direction
+    // pins only change when leaving 0, and the outputs were already off
+    // because the previous step set them to 0.
+    if (left)
+    {
+        FastGPIO::Pin<DIR_L>::setOutput((left < 0) ^ rampFlipLeft);
+    }
+    if (right)
+    {
+        FastGPIO::Pin<DIR_R>::setOutput((right < 0) ^ rampFlipRight);
+    }
+    OCR1B = left < 0 ? -left : left;
+    OCR1A = right < 0 ? -right : right;
+
+    if (left == rampTargetLeft && right == rampTargetRight)
+    {
+        TIMSK1 &= ~(1 << TOIE1);
+    }
+}
+
+template <uint16_t top>
+void Balboa32U4Motors::setTargetSpeedsPwm(int16_t leftSpeed, int16_t rightSpeed)
+{
+    init<top>();
+    if (batteryRefresh) { batteryRefresh(); }
+
+    if (rampStep == 0)
+    {
+        setSpeedsPwm<top>(leftSpeed, rightSpeed);
+        return;
+    }
+
+    leftSpeed = leftSpeed < 0 ? -(int16_t)scaleSpeed<top>(-leftSpeed) : scaleSpeed<top>(leftSpeed);
+    rightSpeed = rightSpeed < 0 ? -(int16_t)scaleSpeed<top>(-rightSpeed) : scaleSpeed<top>(rightSpeed);
+
+    uint8_t oldSREG = SREG;
+    cli();
+    if (!(TIMSK1 & (1 << TOIE1)))
+    {
+        // No ramp is running, so start from the speeds that the motors are
+        // set to now.
+        int16_t left = OCR1B;
+        int16_t right = OCR1A;
+        rampSpeedLeft = (FastGPIO::Pin<DIR_L>::isOutputValueHigh() ^ flipLeft) ? -left : left;
+        rampSpeedRight = (FastGPIO::Pin<DIR_R>::isOutputValueHigh() ^ flipRight) ? -right : right;
+        rampDivider = 1;
+        rampDividerReload = (F_CPU / 2 / 1000) / top;
+        TIFR1 = (1 << TOV1);  // Clear the overflow flag by writing a 1.
+        TIMSK1 |= (1 << TOIE1);
+    }
+    rampTargetLeft = leftSpeed;
+    rampTargetRight = rightSpeed;
+    rampFlipLeft = flipLeft;
+    rampFlipRight = flipRight;
+    SREG = oldSREG;
+}
+
+template void Balboa32U4Motors::setTargetSpeedsPwm<400>(int16_t, int16_t);
+template void Balboa32U4Motors::setTargetSpeedsPwm<800>(int16_t, int16_t);
+template void Balboa32U4Motors::setTargetSpeedsPwm<1600>(int16_t, int16_t);
+
+void Balboa32U4Motors::setTargetSpeeds(int16_t leftSpeed, int16_t rightSpeed)
+{
+    setTargetSpeedsPwm<400>(leftSpeed, rightSpeed);
+}
+
+void Balboa32U4Motors::setAcceleration(uint16_t maxChangePerMs)
+{
+    // Changes of more than the whole speed range of any profile are the same
+    // as no limit.
+    if (maxChangePerMs > 2 * 1600)
+    {
+        maxChangePerMs = 0;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    rampStep = maxChangePerMs;
+    if (maxChangePerMs == 0)
+    {
+        // Apply the targets of any ramp in progress right away instead of
+        // waiting for the rest of the millisecond; see ISR(TIMER1_OVF_vect).
+        rampDivider = 1;
+    }
+    SREG = oldSREG;
+}
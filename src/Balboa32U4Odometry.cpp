@@ -0,0 +1,42 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4Odometry.h>
+#include <avr/pgmspace.h>
+
+// sin(i * pi / 128) for i = 0 to 64, scaled so that 16384 represents 1.
+static const int16_t sineTable[65] PROGMEM =
+{
+        0,   402,   804,  1205,  1606,  2006,  2404,  2801,
+     3196,  3590,  3981,  4370,  4756,  5139,  5520,  5897,
+     6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,
+     9102,  9434,  9760, 10080, 10394, 10702, 11003, 11297,
+    11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+    13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+    15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+    16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+    16384,
+};
+
+int16_t Balboa32U4OdometryBase::sine(uint16_t angle)
+{
+    // The top two bits select the quadrant.  In the second and fourth
+    // quadrants the table is read backwards, and in the third and fourth
+    // quadrants the result is negated.
+    uint16_t a = angle & 0x3FFF;
+    if (angle & 0x4000)
+    {
+        a = 0x4000 - a;
+    }
+
+    uint8_t index = a >> 8;
+    uint8_t fraction = a & 0xFF;
+
+    int16_t value = pgm_read_word(&sineTable[index]);
+    if (fraction)
+    {
+        uint16_t next = pgm_read_word(&sineTable[index + 1]);
+        value += ((uint32_t)(next - value) * fraction) >> 8;
+    }
+
+    return (angle & 0x8000) ? -value : value;
+}
@@ -0,0 +1,166 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4Odometry.h */
+
+#pragma once
+
+#include <stdint.h>
+
+/*! \brief Holds the pose tracked by Balboa32U4Odometry and provides the
+ * integer trigonometry it uses.
+ *
+ * You should not normally use this class directly; see Balboa32U4Odometry. */
+class Balboa32U4OdometryBase
+{
+public:
+
+    /*! Returns the X coordinate of the robot in millimeters.  The X axis
+     *  points in the direction the robot was facing when the pose was last
+     *  reset. */
+    int32_t getX() const { return roundToMillimeters(x); }
+
+    /*! Returns the Y coordinate of the robot in millimeters.  The Y axis
+     *  points to the left of the direction the robot was facing when the pose
+     *  was last reset. */
+    int32_t getY() const { return roundToMillimeters(y); }
+
+    /*! Returns the X coordinate of the robot in micrometers. */
+    int32_t getXMicrometers() const { return x; }
+
+    /*! Returns the Y coordinate of the robot in micrometers. */
+    int32_t getYMicrometers() const { return y; }
+
+    /*! Returns the heading of the robot as a binary angle, where 65536
+     *  corresponds to a full turn.  Turning left (counterclockwise when viewed
+     *  from above) increases the heading.  The value wraps around naturally,
+     *  so the difference between two headings, cast to an int16_t, is the
+     *  signed angle between them. */
+    uint16_t getHeading() const { return heading >> 16; }
+
+    /*! Sets the position to (0, 0) and the heading to 0. */
+    void reset()
+    {
+        x = 0;
+        y = 0;
+        heading = 0;
+    }
+
+    /*! Returns the sine of a binary angle (65536 corresponds to a full turn)
+     * as a signed fixed-point number where 16384 represents 1.
+     *
+     * This uses a 65-entry quarter-wave table in program space with linear
+     * interpolation, so it does not need any floating-point code.  The error
+     * is at most 2 parts in 16384. */
+    static int16_t sine(uint16_t angle);
+
+    /*! Returns the cosine of a binary angle.  See sine(). */
+    static int16_t cosine(uint16_t angle)
+    {
+        return sine(angle + 0x4000);
+    }
+
+protected:
+
+    Balboa32U4OdometryBase() : x(0), y(0), heading(0) { }
+
+    // Converts micrometers to the nearest millimeter.  Division truncates
+    // toward zero, so the rounding offset has to have the same sign as the
+    // value.
+    static int32_t roundToMillimeters(int32_t um)
+    {
+        return (um < 0 ? um - 500 : um + 500) / 1000;
+    }
+
+    // Advances the pose by the given distance (in micrometers) along the
+    // given heading.
+    void advance(int32_t distance, uint16_t direction)
+    {
+        // Add half of the divisor before shifting so the result rounds to
+        // the nearest micrometer instead of always rounding down.
+        x += ((int32_t)distance * cosine(direction) + 0x2000) >> 14;
+        y += ((int32_t)distance * sine(direction) + 0x2000) >> 14;
+    }
+
+    int32_t x;  // micrometers
+    int32_t y;  // micrometers
+
+    // The upper 16 bits are the binary angle returned by getHeading(); the
+    // lower 16 bits keep the fractional part so that small turns add up.
+    uint32_t heading;
+};
+
+/*! \brief Tracks the position and heading of the Balboa from encoder counts.
+ *
+ * This class integrates changes in the encoder counts into an X/Y position and
+ * a heading using differential-drive kinematics.  All of the math is done in
+ * integers, and the sine and cosine come from a small table, so each call to
+ * update() takes only a few hundred CPU cycles.
+ *
+ * The geometry of the robot is given by template parameters so that the
+ * conversion factors are computed by the compiler:
+ *
+ * \tparam trackWidthMm The distance between the centers of the two wheels,
+ *   in millimeters.
+ * \tparam wheelDiameterMm The diameter of the wheels, in millimeters.
+ * \tparam countsPerRevolution The number of encoder counts per wheel
+ *   revolution.  The default is right for the standard Balboa motors (see
+ *   Balboa32U4Encoders).
+ *
+ * Example:
+ *
+ * ~~~{.cpp}
+ * Balboa32U4Encoders encoders;
+ * Balboa32U4Odometry<100> odometry;
+ *
+ * // Call this at a fixed rate, such as every 10 ms.
+ * void updateOdometry()
+ * {
+ *   Balboa32U4Encoders::Snapshot snapshot = encoders.getSnapshot();
+ *   odometry.update(snapshot.deltaLeft, snapshot.deltaRight);
+ * }
+ * ~~~
+ */
+template <uint16_t trackWidthMm, uint16_t wheelDiameterMm = 80,
+    uint16_t countsPerRevolution = 1437>
+class Balboa32U4Odometry : public Balboa32U4OdometryBase
+{
+public:
+
+    /*! Updates the pose with the changes in the encoder counts since the last
+     * update.
+     *
+     * \param deltaLeft The change in the left encoder count.
+     * \param deltaRight The change in the right encoder count.
+     *
+     * The robot is assumed to have moved along a circular arc, so the
+     * position is advanced along the heading halfway between the old and new
+     * headings.  Call this often enough that each wheel moves less than a
+     * quarter of a revolution between calls. */
+    void update(int16_t deltaLeft, int16_t deltaRight)
+    {
+        int32_t turn = ((int32_t)deltaRight - deltaLeft) * (int32_t)headingPerCount;
+        uint16_t direction = (heading + turn / 2) >> 16;
+        heading += turn;
+
+        // The distance traveled by the center of the robot, in micrometers.
+        int32_t distance =
+            (((int32_t)deltaLeft + deltaRight) * (int32_t)distancePerCount + 0x100) >> 9;
+
+        advance(distance, direction);
+    }
+
+private:
+
+    // The distance traveled by a wheel for each encoder count, in
+    // micrometers, as a fixed-point number with 8 fractional bits.  We use
+    // 355/113 as an approximation of pi.
+    static const uint32_t distancePerCount =
+        ((uint64_t)wheelDiameterMm * 1000 * 355 * 256 + 113UL * countsPerRevolution / 2)
+        / (113UL * countsPerRevolution);
+
+    // The change in heading for each count of difference between the wheels,
+    // in units of 1/65536 of a binary angle (2^32 per turn).  This is
+    // (pi * D / CPR) / W radians times 2^31 / pi, so pi cancels out.
+    static const uint32_t headingPerCount =
+        ((uint64_t)wheelDiameterMm << 31) / ((uint32_t)countsPerRevolution * trackWidthMm);
+};
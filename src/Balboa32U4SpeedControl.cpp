@@ -0,0 +1,157 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+#include <Balboa32U4SpeedControl.h>
+#include <Balboa32U4Encoders.h>
+#include <Balboa32U4Motors.h>
+#include <Arduino.h>
+
+// The largest motor setting that the integral term can reach on its own.
+// This is the full range of Balboa32U4Motors; the outputs themselves are
+// limited to Balboa32U4Motors::getMaxSpeed() when they are calculated.
+#define INTEGRAL_OUTPUT_LIMIT 400
+
+Balboa32U4SpeedControl::Balboa32U4SpeedControl()
+{
+    configureGains(left, 0, 0, 0);
+    configureGains(right, 0, 0, 0);
+    left.output = right.output = 0;
+    lastUpdateMillis = 0;
+    periodMs = 5;
+    setTargetSpeeds(0, 0);
+    reset();
+}
+
+void Balboa32U4SpeedControl::configureGains(Wheel & wheel, uint16_t kp, uint16_t ki, uint16_t kd)
+{
+    wheel.kp = kp;
+    wheel.ki = ki;
+    wheel.kd = kd;
+    wheel.integralLimit = ki ? ((int32_t)INTEGRAL_OUTPUT_LIMIT << 16) / ki : 0;
+}
+
+void Balboa32U4SpeedControl::setGainsLeft(uint16_t kp, uint16_t ki, uint16_t kd)
+{
+    configureGains(left, kp, ki, kd);
+}
+
+void Balboa32U4SpeedControl::setGainsRight(uint16_t kp, uint16_t ki, uint16_t kd)
+{
+    configureGains(right, kp, ki, kd);
+}
+
+void Balboa32U4SpeedControl::setUpdatePeriod(uint8_t period)
+{
+    if (period == 0) { period = 1; }
+    periodMs = period;
+    setTargetSpeeds(left.targetSpeed, right.targetSpeed);
+    reset();
+}
+
+int32_t Balboa32U4SpeedControl::countsPerPeriod(int16_t countsPerSecond)
+{
+    // Do the division here, once, so that update() only needs to multiply.
+    return ((int32_t)countsPerSecond * periodMs * 256) / 1000;
+}
+
+void Balboa32U4SpeedControl::setTargetSpeeds(int16_t leftSpeed, int16_t rightSpeed)
+{
+    left.targetSpeed = leftSpeed;
+    right.targetSpeed = rightSpeed;
+    left.target = countsPerPeriod(leftSpeed);
+    right.target = countsPerPeriod(rightSpeed);
+}
+
+void Balboa32U4SpeedControl::reset()
+{
+    left.integral = right.integral = 0;
+    primed = false;
+}
+
+int16_t Balboa32U4SpeedControl::updateWheel(Wheel & wheel, int16_t counts,
+    int16_t outputLimit)
+{
+    int16_t delta = counts - wheel.lastCounts;
+    wheel.lastCounts = counts;
+
+    // The error in counts per period, times 256, limited so that multiplying
+    // it by a 16-bit gain cannot overflow.
+    int32_t error = wheel.target - ((int32_t)delta << 8);
+    if (error > 32767) { error = 32767; }
+    if (error < -32767) { error = -32767; }
+
+    int32_t integral = wheel.integral + error;
+    if (integral > wheel.integralLimit) { integral = wheel.integralLimit; }
+    if (integral < -wheel.integralLimit) { integral = -wheel.integralLimit; }
+
+    // Use the change in the measurement instead of the change in the error
+    // for the derivative term, so that changing the target does not cause a
+    // spike.
+    int32_t derivative = -((int32_t)(delta - wheel.lastDelta) << 8);
+    if (derivative > 32767) { derivative = 32767; }
+    if (derivative < -32767) { derivative = -32767; }
+    wheel.lastDelta = delta;
+
+    // Each product fits in 32 bits, but their sum might not, so each term is
+    // scaled down before they are added.
+    int32_t output = ((int32_t)wheel.kp * error) >> 16;
+    output += ((int32_t)wheel.ki * integral) >> 16;
+    output += ((int32_t)wheel.kd * derivative) >> 16;
+
+    // When the output saturates, only let the integral term move back toward
+    // the usable range (anti-windup).
+    if (output > outputLimit)
+    {
+        output = outputLimit;
+        if (error > 0) { integral = wheel.integral; }
+    }
+    else if (output < -outputLimit)
+    {
+        output = -outputLimit;
+        if (error < 0) { integral = wheel.integral; }
+    }
+    wheel.integral = integral;
+
+    return output;
+}
+
+bool Balboa32U4SpeedControl::update()
+{
+    uint16_t ms = millis();
+    uint16_t elapsed = ms - lastUpdateMillis;
+    if (primed && elapsed < periodMs) { return false; }
+
+    // Advance by exactly one period so that a late call does not delay all of
+    // the later updates, unless we are so far behind that catching up would
+    // mean running several updates back to back.
+    if (primed && elapsed < 2 * periodMs)
+    {
+        lastUpdateMillis += periodMs;
+    }
+    else
+    {
+        lastUpdateMillis = ms;
+    }
+
+    // Both counts come from the same instant.  Only the running totals are
+    // used (truncated to 16 bits; the differences still wrap correctly) so
+    // that other users of getSnapshot() do not affect our deltas.
+    Balboa32U4Encoders::Snapshot snapshot = Balboa32U4Encoders::getSnapshot();
+    int16_t countsLeft = snapshot.countsLeft;
+    int16_t countsRight = snapshot.countsRight;
+
+    if (!primed)
+    {
+        // We need one set of counts before we can measure speed.
+        left.lastCounts = countsLeft;
+        right.lastCounts = countsRight;
+        left.lastDelta = right.lastDelta = 0;
+        primed = true;
+        return false;
+    }
+
+    int16_t outputLimit = Balboa32U4Motors::getMaxSpeed();
+    left.output = updateWheel(left, countsLeft, outputLimit);
+    right.output = updateWheel(right, countsRight, outputLimit);
+    Balboa32U4Motors::setSpeeds(left.output, right.output);
+    return true;
+}
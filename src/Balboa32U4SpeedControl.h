@@ -0,0 +1,120 @@
+// Copyright Pololu Corporation.  For more information, see http://www.pololu.com/
+
+/*! \file Balboa32U4SpeedControl.h */
+
+#pragma once
+
+#include <stdint.h>
+
+/*! \brief Controls the speed of each wheel using feedback from the encoders.
+ *
+ * Balboa32U4Motors sets the duty cycle of each motor, so the speed you get for
+ * a given setting depends on the battery voltage and the load on the wheel.
+ * This class instead takes target speeds in encoder counts per second and
+ * uses a PID controller for each wheel to adjust the motor settings until the
+ * measured speeds match.
+ *
+ * Call update() as often as possible from your main loop; it runs the
+ * controllers at a fixed rate (every 5 ms by default) and returns immediately
+ * at other times.  All of the calculations are done with integers.
+ *
+ * This class reads the encoders with Balboa32U4Encoders::getSnapshot() and
+ * sets the motors with Balboa32U4Motors::setSpeeds().  While you are using
+ * it, you should not set the motor speeds yourself.  Other code can still
+ * read and reset the encoder counts, since that does not affect the
+ * snapshots.
+ *
+ * The gains are fixed-point numbers where 256 represents 1.  The error that
+ * they multiply is measured in encoder counts per update period, and the
+ * result is in the units used by Balboa32U4Motors (-300 to 300, or -400 to
+ * 400 in turbo mode; see Balboa32U4Motors::allowTurbo()).  For
+ * example, a proportional gain of 5120 means that the motor setting changes by
+ * 20 for each count per update period that the wheel is too slow.  Since the
+ * error is per update period, you should retune the gains if you change the
+ * period. */
+class Balboa32U4SpeedControl
+{
+public:
+
+    Balboa32U4SpeedControl();
+
+    /*! \brief Sets the PID gains for the left wheel.
+     *
+     * \param kp The proportional gain.
+     * \param ki The integral gain.
+     * \param kd The derivative gain.
+     *
+     * See the class description for the units.  The integral term is limited
+     * so that it cannot exceed the motor range on its own (anti-windup). */
+    void setGainsLeft(uint16_t kp, uint16_t ki, uint16_t kd);
+
+    /*! \brief Sets the PID gains for the right wheel.  See setGainsLeft(). */
+    void setGainsRight(uint16_t kp, uint16_t ki, uint16_t kd);
+
+    /*! \brief Sets the PID gains for both wheels.  See setGainsLeft(). */
+    void setGains(uint16_t kp, uint16_t ki, uint16_t kd)
+    {
+        setGainsLeft(kp, ki, kd);
+        setGainsRight(kp, ki, kd);
+    }
+
+    /*! \brief Sets how often update() runs the controllers, in milliseconds.
+     *
+     * The default is 5 ms (200 Hz).  This also resets the controllers. */
+    void setUpdatePeriod(uint8_t period);
+
+    /*! \brief Sets the target speed of each wheel in encoder counts per
+     * second.  Positive speeds correspond to forward movement. */
+    void setTargetSpeeds(int16_t leftSpeed, int16_t rightSpeed);
+
+    /*! \brief Runs the controllers if the update period has passed.
+     *
+     * \return True if the controllers ran and the motor speeds were updated. */
+    bool update();
+
+    /*! \brief Clears the integral terms and stops using the previous speed
+     * measurements.
+     *
+     * The motors are not changed until the next update. */
+    void reset();
+
+    /*! \brief Returns the motor setting most recently sent to the left
+     *  motor. */
+    int16_t getOutputLeft() const { return left.output; }
+
+    /*! \brief Returns the motor setting most recently sent to the right
+     *  motor. */
+    int16_t getOutputRight() const { return right.output; }
+
+private:
+
+    struct Wheel
+    {
+        uint16_t kp;
+        uint16_t ki;
+        uint16_t kd;
+
+        // The integral term is clamped to +/- this value.
+        int32_t integralLimit;
+
+        // The target speed in counts per second, and in counts per update
+        // period times 256.
+        int16_t targetSpeed;
+        int32_t target;
+
+        int32_t integral;
+        int16_t lastCounts;
+        int16_t lastDelta;
+        int16_t output;
+    };
+
+    static void configureGains(Wheel & wheel, uint16_t kp, uint16_t ki, uint16_t kd);
+    int32_t countsPerPeriod(int16_t countsPerSecond);
+    static int16_t updateWheel(Wheel & wheel, int16_t counts, int16_t outputLimit);
+
+    Wheel left;
+    Wheel right;
+    uint16_t lastUpdateMillis;
+    uint8_t periodMs;
+    bool primed;
+};
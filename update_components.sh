@@ -29,7 +29,7 @@ copylib()
   # Copy the code files.
   until [ -z "$1" ]
   do
-    cp $dir/$1 $LIBDIR
+    cp $dir/$1 $LIBDIR/src
     shift
   done
 